@@ -0,0 +1,758 @@
+/*
+ * Copyright (c) 2018, Hamid Alaei Varnosfaderani
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * End-to-end benchmark of the module against a local redis-server.
+ *
+ * A redis-server is started with the module loaded, then producers and workers, each on its own connection and
+ * thread, run every scenario for every payload size. The results are printed as one JSON object per line.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../src/histogram.h"
+
+#ifndef LARAVELQ_MODULE_PATH
+#define LARAVELQ_MODULE_PATH "liblaravelq.so"
+#endif
+
+/* ------------------------------------------------------------------------------------------------------------------
+ * Minimal RESP client
+ * --------------------------------------------------------------------------------------------------------------- */
+
+typedef struct Reply
+{
+    /**
+     * '+', '-', ':', '$' or '*'.
+     */
+    char type;
+    /**
+     * The value of an integer, or the length of a bulk string or an array, -1 for null.
+     */
+    long long integer;
+    char *str;
+    size_t len;
+    struct Reply *elements;
+} Reply;
+
+typedef struct Connection
+{
+    int fd;
+    char *in;
+    size_t inPos, inLen, inCap;
+    char *out;
+    size_t outLen, outCap;
+} Connection;
+
+static void fail(const char *message)
+{
+    fprintf(stderr, "laravelq-bench: %s\n", message);
+    exit(1);
+}
+
+static void *xmalloc(size_t size)
+{
+    void *ptr = malloc(size);
+    if (! ptr) {
+        fail("out of memory");
+    }
+    return ptr;
+}
+
+static int connectTo(Connection *conn, int port)
+{
+    memset(conn, 0, sizeof(Connection));
+    conn->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (conn->fd < 0) {
+        return -1;
+    }
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t) port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(conn->fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        close(conn->fd);
+        return -1;
+    }
+    int one = 1;
+    setsockopt(conn->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    conn->inCap = conn->outCap = 16 * 1024;
+    conn->in = xmalloc(conn->inCap);
+    conn->out = xmalloc(conn->outCap);
+    return 0;
+}
+
+static void disconnectFrom(Connection *conn)
+{
+    close(conn->fd);
+    free(conn->in);
+    free(conn->out);
+}
+
+static void appendOut(Connection *conn, const char *data, size_t len)
+{
+    if (conn->outLen + len > conn->outCap) {
+        while (conn->outLen + len > conn->outCap) {
+            conn->outCap *= 2;
+        }
+        conn->out = realloc(conn->out, conn->outCap);
+        if (! conn->out) {
+            fail("out of memory");
+        }
+    }
+    memcpy(conn->out + conn->outLen, data, len);
+    conn->outLen += len;
+}
+
+static void sendCommand(Connection *conn, int argc, const char **argv, const size_t *lens)
+{
+    char header[32];
+    conn->outLen = 0;
+    appendOut(conn, header, (size_t) snprintf(header, sizeof(header), "*%d\r\n", argc));
+    for (int i = 0; i < argc; ++i) {
+        size_t len = lens ? lens[i] : strlen(argv[i]);
+        appendOut(conn, header, (size_t) snprintf(header, sizeof(header), "$%zu\r\n", len));
+        appendOut(conn, argv[i], len);
+        appendOut(conn, "\r\n", 2);
+    }
+    size_t written = 0;
+    while (written < conn->outLen) {
+        ssize_t n = write(conn->fd, conn->out + written, conn->outLen - written);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            fail("connection lost while writing");
+        }
+        written += (size_t) n;
+    }
+}
+
+/**
+ * Make sure at least n unread bytes are buffered.
+ */
+static void fill(Connection *conn, size_t n)
+{
+    if (conn->inLen - conn->inPos >= n) {
+        return;
+    }
+    memmove(conn->in, conn->in + conn->inPos, conn->inLen - conn->inPos);
+    conn->inLen -= conn->inPos;
+    conn->inPos = 0;
+    if (n > conn->inCap) {
+        while (n > conn->inCap) {
+            conn->inCap *= 2;
+        }
+        conn->in = realloc(conn->in, conn->inCap);
+        if (! conn->in) {
+            fail("out of memory");
+        }
+    }
+    while (conn->inLen < n) {
+        ssize_t r = read(conn->fd, conn->in + conn->inLen, conn->inCap - conn->inLen);
+        if (r < 0 && errno == EINTR) {
+            continue;
+        }
+        if (r <= 0) {
+            fail("connection lost while reading");
+        }
+        conn->inLen += (size_t) r;
+    }
+}
+
+/**
+ * Read a line without its CRLF.
+ */
+static char *readLine(Connection *conn, size_t *len)
+{
+    size_t scanned = 0;
+    for (;;) {
+        char *start = conn->in + conn->inPos;
+        size_t available = conn->inLen - conn->inPos;
+        for (size_t i = scanned; i + 1 < available; ++i) {
+            if (start[i] == '\r' && start[i + 1] == '\n') {
+                *len = i;
+                conn->inPos += i + 2;
+                return start;
+            }
+        }
+        scanned = available ? available - 1 : 0;
+        fill(conn, available + 1);
+    }
+}
+
+static char *copyString(const char *str, size_t len)
+{
+    char *copy = xmalloc(len + 1);
+    memcpy(copy, str, len);
+    copy[len] = 0;
+    return copy;
+}
+
+static void readReply(Connection *conn, Reply *reply)
+{
+    size_t len;
+    char *line = readLine(conn, &len);
+    memset(reply, 0, sizeof(Reply));
+    reply->type = line[0];
+    switch (reply->type) {
+        case '+':
+        case '-':
+            reply->str = copyString(line + 1, len - 1);
+            reply->len = len - 1;
+            break;
+        case ':':
+            reply->integer = strtoll(line + 1, NULL, 10);
+            break;
+        case '$':
+            reply->integer = strtoll(line + 1, NULL, 10);
+            if (reply->integer >= 0) {
+                reply->len = (size_t) reply->integer;
+                fill(conn, reply->len + 2);
+                reply->str = copyString(conn->in + conn->inPos, reply->len);
+                conn->inPos += reply->len + 2;
+            }
+            break;
+        case '*':
+            reply->integer = strtoll(line + 1, NULL, 10);
+            if (reply->integer > 0) {
+                reply->elements = xmalloc(sizeof(Reply) * (size_t) reply->integer);
+                for (long long i = 0; i < reply->integer; ++i) {
+                    readReply(conn, &reply->elements[i]);
+                }
+            }
+            break;
+        default:
+            fail("protocol error");
+    }
+}
+
+static void freeReply(Reply *reply)
+{
+    if (reply->type == '*') {
+        for (long long i = 0; i < reply->integer; ++i) {
+            freeReply(&reply->elements[i]);
+        }
+        free(reply->elements);
+    }
+    free(reply->str);
+}
+
+/**
+ * Send a command and read its reply. An error reply aborts the benchmark.
+ */
+static void command(Connection *conn, Reply *reply, int argc, const char **argv, const size_t *lens)
+{
+    sendCommand(conn, argc, argv, lens);
+    readReply(conn, reply);
+    if (reply->type == '-') {
+        fprintf(stderr, "laravelq-bench: %s failed: %s\n", argv[0], reply->str);
+        exit(1);
+    }
+}
+
+/* ------------------------------------------------------------------------------------------------------------------
+ * Benchmark
+ * --------------------------------------------------------------------------------------------------------------- */
+
+static long long nstime(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long) ts.tv_sec * 1000000000ll + ts.tv_nsec;
+}
+
+static void sleepUntil(long long ns)
+{
+    long long delta = ns - nstime();
+    if (delta > 0) {
+        struct timespec ts = {(time_t) (delta / 1000000000ll), (long) (delta % 1000000000ll)};
+        nanosleep(&ts, NULL);
+    }
+}
+
+typedef struct Options
+{
+    const char *server;
+    const char *module;
+    int port;
+    int external;
+    int verbose;
+    long long jobs;
+    int producers;
+    int workers;
+    int fanoutWorkers;
+    long long fanoutRate;
+    long long delayMs;
+    long long blockForMs;
+    char *scenarios;
+    char *payloads;
+} Options;
+
+typedef struct Scenario
+{
+    const char *name;
+    /**
+     * Push the jobs with laravel.later instead of laravel.push.
+     */
+    int later;
+    /**
+     * Release each job once before it is deleted.
+     */
+    int release;
+    /**
+     * Many workers wait blocked while the producers push at a steady rate.
+     */
+    int fanout;
+} Scenario;
+
+static const Scenario scenarios[] = {
+        {"push-pop-delete", 0, 0, 0},
+        {"later-release", 1, 1, 0},
+        {"fanout", 0, 0, 1},
+};
+
+#define OP_PUSH 0
+#define OP_LATER 1
+#define OP_POP 2
+#define OP_DELETE 3
+#define OP_RELEASE 4
+#define OP_E2E 5
+#define OPS 6
+
+static const char *opNames[OPS] = {"push", "later", "pop", "delete", "release", "end-to-end"};
+
+/**
+ * Shared by the threads of a run.
+ */
+typedef struct Run
+{
+    const Options *options;
+    const Scenario *scenario;
+    size_t payload;
+    char queue[64], delayed[80], reserved[80];
+    long long jobs;
+    long long rate;
+    int producers;
+    int workers;
+    long long completed;
+    volatile int done;
+    long long startedAt;
+    long long finishedAt;
+} Run;
+
+typedef struct Thread
+{
+    pthread_t id;
+    Run *run;
+    int index;
+    Connection conn;
+    Histogram latency[OPS];
+} Thread;
+
+static void connectThread(Thread *thread)
+{
+    if (connectTo(&thread->conn, thread->run->options->port) < 0) {
+        fail("can't connect to redis-server");
+    }
+}
+
+/**
+ * A laravel-like json job, padded to the payload size, which carries the time it is pushed at.
+ */
+static size_t makeJob(char *buffer, size_t payload, long long id)
+{
+    int len = sprintf(buffer, "{\"uuid\":\"%lld\",\"displayName\":\"Bench\",\"attempts\":0,"
+                                            "\"pushedAt\":%lld,\"data\":\"", id, nstime());
+    size_t size = (size_t) len + 2 > payload ? (size_t) len + 2 : payload;
+    memset(buffer + len, 'x', size - 2 - (size_t) len);
+    buffer[size - 2] = '"';
+    buffer[size - 1] = '}';
+    return size;
+}
+
+static long long jobPushedAt(const char *job)
+{
+    const char *at = strstr(job, "\"pushedAt\":");
+    return at ? strtoll(at + 11, NULL, 10) : 0;
+}
+
+static long long jobAttempts(const char *job)
+{
+    const char *at = strstr(job, "\"attempts\":");
+    return at ? strtoll(at + 11, NULL, 10) : 0;
+}
+
+static void *producer(void *data)
+{
+    Thread *thread = data;
+    Run *run = thread->run;
+    connectThread(thread);
+    // The padding is left out when the payload is smaller than the json around it.
+    char *job = xmalloc(run->payload + 256);
+    char delay[32];
+    snprintf(delay, sizeof(delay), "%lld", run->options->delayMs);
+    long long jobs = run->jobs / run->producers + (thread->index < run->jobs % run->producers);
+    long long interval = run->rate > 0 ? 1000000000ll * run->producers / run->rate : 0;
+    long long next = nstime();
+    for (long long i = 0; i < jobs; ++i) {
+        if (interval) {
+            sleepUntil(next);
+            next += interval;
+        }
+        size_t len = makeJob(job, run->payload, i * run->producers + thread->index);
+        Reply reply;
+        long long start = nstime();
+        if (run->scenario->later) {
+            const char *argv[] = {"laravel.later", run->delayed, delay, job};
+            size_t lens[] = {13, strlen(run->delayed), strlen(delay), len};
+            command(&thread->conn, &reply, 4, argv, lens);
+            Histogram_Record(&thread->latency[OP_LATER], nstime() - start);
+        } else {
+            const char *argv[] = {"laravel.push", run->queue, job};
+            size_t lens[] = {12, strlen(run->queue), len};
+            command(&thread->conn, &reply, 3, argv, lens);
+            Histogram_Record(&thread->latency[OP_PUSH], nstime() - start);
+        }
+        freeReply(&reply);
+    }
+    free(job);
+    disconnectFrom(&thread->conn);
+    return NULL;
+}
+
+static void *worker(void *data)
+{
+    Thread *thread = data;
+    Run *run = thread->run;
+    connectThread(thread);
+    char blockFor[32], delay[32];
+    snprintf(blockFor, sizeof(blockFor), "%lld", run->options->blockForMs);
+    snprintf(delay, sizeof(delay), "%lld", run->options->delayMs);
+    const char *pop[] = {"laravel.pop", run->queue, run->delayed, run->reserved, "60000", blockFor};
+    while (! run->done) {
+        Reply reply, done;
+        long long start = nstime();
+        command(&thread->conn, &reply, 6, pop, NULL);
+        long long end = nstime();
+        if (reply.type != '*' || reply.integer != 2) {
+            // Timed out
+            freeReply(&reply);
+            continue;
+        }
+        Histogram_Record(&thread->latency[OP_POP], end - start);
+        Histogram_Record(&thread->latency[OP_E2E], end - jobPushedAt(reply.elements[0].str));
+        Reply *reserved = &reply.elements[1];
+        start = nstime();
+        if (run->scenario->release && jobAttempts(reserved->str) < 2) {
+            const char *argv[] = {"laravel.release", run->delayed, run->reserved, reserved->str, delay};
+            size_t lens[] = {15, strlen(run->delayed), strlen(run->reserved), reserved->len, strlen(delay)};
+            command(&thread->conn, &done, 5, argv, lens);
+            Histogram_Record(&thread->latency[OP_RELEASE], nstime() - start);
+        } else {
+            const char *argv[] = {"laravel.delete", run->reserved, reserved->str};
+            size_t lens[] = {14, strlen(run->reserved), reserved->len};
+            command(&thread->conn, &done, 3, argv, lens);
+            end = nstime();
+            Histogram_Record(&thread->latency[OP_DELETE], end - start);
+            if (__sync_add_and_fetch(&run->completed, 1) == run->jobs) {
+                run->finishedAt = end;
+                run->done = 1;
+            }
+        }
+        freeReply(&done);
+        freeReply(&reply);
+    }
+    disconnectFrom(&thread->conn);
+    return NULL;
+}
+
+static void mergeHistogram(Histogram *into, const Histogram *from)
+{
+    if (! from->total) {
+        return;
+    }
+    if (! into->total || from->min < into->min) {
+        into->min = from->min;
+    }
+    if (from->max > into->max) {
+        into->max = from->max;
+    }
+    for (int i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+        into->counts[i] += from->counts[i];
+    }
+    into->total += from->total;
+}
+
+static void report(const Run *run, const char *op, const Histogram *histogram, double seconds)
+{
+    Histogram h = *histogram;
+    printf("{\"scenario\":\"%s\",\"payload\":%zu,\"producers\":%d,\"workers\":%d,\"jobs\":%lld,\"op\":\"%s\","
+           "\"count\":%llu,\"ops_per_sec\":%.1f,\"min_us\":%.3f,\"p50_us\":%.3f,\"p90_us\":%.3f,\"p99_us\":%.3f,"
+           "\"p999_us\":%.3f,\"max_us\":%.3f}\n",
+           run->scenario->name, run->payload, run->producers, run->workers, run->jobs, op,
+           (unsigned long long) h.total, seconds > 0 ? h.total / seconds : 0, h.min / 1000.0,
+           Histogram_Quantile(&h, 0.5) / 1000.0, Histogram_Quantile(&h, 0.9) / 1000.0,
+           Histogram_Quantile(&h, 0.99) / 1000.0, Histogram_Quantile(&h, 0.999) / 1000.0, h.max / 1000.0);
+}
+
+static void runScenario(const Options *options, const Scenario *scenario, size_t payload)
+{
+    Run run;
+    memset(&run, 0, sizeof(Run));
+    run.options = options;
+    run.scenario = scenario;
+    run.payload = payload;
+    run.jobs = options->jobs;
+    run.producers = options->producers;
+    run.workers = scenario->fanout ? options->fanoutWorkers : options->workers;
+    run.rate = scenario->fanout ? options->fanoutRate : 0;
+    snprintf(run.queue, sizeof(run.queue), "bench:%s:%zu", scenario->name, payload);
+    snprintf(run.delayed, sizeof(run.delayed), "%s:delayed", run.queue);
+    snprintf(run.reserved, sizeof(run.reserved), "%s:reserved", run.queue);
+
+    Connection conn;
+    Reply reply;
+    if (connectTo(&conn, options->port) < 0) {
+        fail("can't connect to redis-server");
+    }
+    const char *del[] = {"del", run.queue, run.delayed, run.reserved};
+    command(&conn, &reply, 4, del, NULL);
+    freeReply(&reply);
+
+    int threads = run.producers + run.workers;
+    Thread *thread = calloc((size_t) threads, sizeof(Thread));
+    if (! thread) {
+        fail("out of memory");
+    }
+    run.startedAt = nstime();
+    // Workers first, so the fan-out starts with all of them blocked.
+    for (int i = 0; i < threads; ++i) {
+        thread[i].run = &run;
+        thread[i].index = i < run.workers ? i : i - run.workers;
+        if (pthread_create(&thread[i].id, NULL, i < run.workers ? worker : producer, &thread[i])) {
+            fail("can't create thread");
+        }
+    }
+    for (int i = 0; i < threads; ++i) {
+        pthread_join(thread[i].id, NULL);
+    }
+    double seconds = (run.finishedAt - run.startedAt) / 1e9;
+
+    Histogram merged[OPS];
+    memset(merged, 0, sizeof(merged));
+    for (int i = 0; i < threads; ++i) {
+        for (int op = 0; op < OPS; ++op) {
+            mergeHistogram(&merged[op], &thread[i].latency[op]);
+        }
+    }
+    for (int op = 0; op < OPS; ++op) {
+        if (merged[op].total) {
+            report(&run, opNames[op], &merged[op], seconds);
+        }
+    }
+    fflush(stdout);
+    free(thread);
+
+    command(&conn, &reply, 4, del, NULL);
+    freeReply(&reply);
+    disconnectFrom(&conn);
+}
+
+/* ------------------------------------------------------------------------------------------------------------------
+ * Server
+ * --------------------------------------------------------------------------------------------------------------- */
+
+static pid_t startServer(const Options *options)
+{
+    char port[16];
+    snprintf(port, sizeof(port), "%d", options->port);
+    pid_t pid = fork();
+    if (pid < 0) {
+        fail("can't fork");
+    }
+    if (pid == 0) {
+        if (! options->verbose) {
+            int null = open("/dev/null", O_WRONLY);
+            dup2(null, STDOUT_FILENO);
+        }
+        execlp(options->server, options->server, "--port", port, "--bind", "127.0.0.1", "--save", "",
+               "--appendonly", "no", "--loadmodule", options->module, (char *) NULL);
+        fprintf(stderr, "laravelq-bench: can't run %s: %s\n", options->server, strerror(errno));
+        _exit(127);
+    }
+    for (int attempt = 0; attempt < 100; ++attempt) {
+        Connection conn;
+        int status;
+        if (waitpid(pid, &status, WNOHANG) == pid) {
+            fail("redis-server exited, is the module path right?");
+        }
+        if (connectTo(&conn, options->port) == 0) {
+            const char *ping[] = {"ping"};
+            Reply reply;
+            sendCommand(&conn, 1, ping, NULL);
+            readReply(&conn, &reply);
+            int ready = reply.type == '+';
+            freeReply(&reply);
+            disconnectFrom(&conn);
+            if (ready) {
+                return pid;
+            }
+        }
+        sleepUntil(nstime() + 50000000ll);
+    }
+    kill(pid, SIGKILL);
+    fail("redis-server did not start");
+    return pid;
+}
+
+static void stopServer(pid_t pid)
+{
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "Usage: laravelq-bench [options]\n"
+            "  --server <path>          redis-server to run (default redis-server)\n"
+            "  --module <path>          module to load (default %s)\n"
+            "  --port <port>            (default 6399)\n"
+            "  --external               use the redis-server already listening on the port\n"
+            "  --verbose                show the output of redis-server\n"
+            "  --jobs <n>               jobs per run (default 20000)\n"
+            "  --producers <n>          (default 4)\n"
+            "  --workers <n>            (default 4)\n"
+            "  --fanout-workers <n>     workers of the fanout scenario (default 64)\n"
+            "  --fanout-rate <n>        jobs per second pushed in the fanout scenario (default 10000)\n"
+            "  --delay <ms>             delay of later and release (default 10)\n"
+            "  --block-for <ms>         block-for of the workers (default 100)\n"
+            "  --scenarios <list>       push-pop-delete,later-release,fanout (default all)\n"
+            "  --payloads <list>        payload sizes in bytes (default 200,1000,10000,100000)\n",
+            LARAVELQ_MODULE_PATH);
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    Options options = {"redis-server", LARAVELQ_MODULE_PATH, 6399, 0, 0, 20000, 4, 4, 64, 10000, 10, 100,
+                       NULL, NULL};
+    char defaultScenarios[] = "push-pop-delete,later-release,fanout";
+    char defaultPayloads[] = "200,1000,10000,100000";
+    options.scenarios = defaultScenarios;
+    options.payloads = defaultPayloads;
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        if (! strcmp(arg, "--external")) {
+            options.external = 1;
+        } else if (! strcmp(arg, "--verbose")) {
+            options.verbose = 1;
+        } else if (i + 1 == argc) {
+            usage();
+        } else if (! strcmp(arg, "--server")) {
+            options.server = argv[++i];
+        } else if (! strcmp(arg, "--module")) {
+            options.module = argv[++i];
+        } else if (! strcmp(arg, "--port")) {
+            options.port = atoi(argv[++i]);
+        } else if (! strcmp(arg, "--jobs")) {
+            options.jobs = atoll(argv[++i]);
+        } else if (! strcmp(arg, "--producers")) {
+            options.producers = atoi(argv[++i]);
+        } else if (! strcmp(arg, "--workers")) {
+            options.workers = atoi(argv[++i]);
+        } else if (! strcmp(arg, "--fanout-workers")) {
+            options.fanoutWorkers = atoi(argv[++i]);
+        } else if (! strcmp(arg, "--fanout-rate")) {
+            options.fanoutRate = atoll(argv[++i]);
+        } else if (! strcmp(arg, "--delay")) {
+            options.delayMs = atoll(argv[++i]);
+        } else if (! strcmp(arg, "--block-for")) {
+            options.blockForMs = atoll(argv[++i]);
+        } else if (! strcmp(arg, "--scenarios")) {
+            options.scenarios = argv[++i];
+        } else if (! strcmp(arg, "--payloads")) {
+            options.payloads = argv[++i];
+        } else {
+            usage();
+        }
+    }
+    if (options.jobs < 1 || options.producers < 1 || options.workers < 1 || options.fanoutWorkers < 1 ||
+            options.blockForMs < 1 || options.delayMs < 0) {
+        usage();
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    pid_t server = options.external ? 0 : startServer(&options);
+    char *savedScenario;
+    for (char *name = strtok_r(options.scenarios, ",", &savedScenario); name;
+            name = strtok_r(NULL, ",", &savedScenario)) {
+        const Scenario *scenario = NULL;
+        for (size_t i = 0; i < sizeof(scenarios) / sizeof(Scenario); ++i) {
+            if (! strcmp(scenarios[i].name, name)) {
+                scenario = &scenarios[i];
+            }
+        }
+        if (! scenario) {
+            fprintf(stderr, "laravelq-bench: unknown scenario %s\n", name);
+            continue;
+        }
+        char *payloads = copyString(options.payloads, strlen(options.payloads));
+        char *savedPayload;
+        for (char *size = strtok_r(payloads, ",", &savedPayload); size; size = strtok_r(NULL, ",", &savedPayload)) {
+            long long payload = atoll(size);
+            if (payload > 0) {
+                runScenario(&options, scenario, (size_t) payload);
+            }
+        }
+        free(payloads);
+    }
+    if (server) {
+        stopServer(server);
+    }
+    return 0;
+}
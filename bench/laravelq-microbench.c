@@ -0,0 +1,502 @@
+/*
+ * Copyright (c) 2018, Hamid Alaei Varnosfaderani
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Microbenchmarks of the module internals, linked against the module sources and the mock module API.
+ *
+ * Each benchmark prints one JSON object per line with its nanoseconds per operation. Run a single one with --only
+ * to profile it under perf or callgrind. --check verifies the formats the module stores instead, and aborts on the
+ * first failure.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "redismodule-mock.h"
+#include "../src/blocking-pop.h"
+#include "../src/containers.h"
+#include "../src/envelope.h"
+#include "../src/compression.h"
+#include "../src/config.h"
+#include "../src/job-attempts.h"
+
+/* Defined in the module sources, without a header of their own. */
+void setupMemoryManagement();
+RedisModuleString * incrementAttempts(RedisModuleCtx *ctx, RedisModuleString *job, long long *newAttempts);
+RedisModuleString * incrementAttemptsWithParser(RedisModuleCtx *ctx, const char *str, size_t len, long long *newAttempts);
+RedisModuleString * reserveJob(RedisModuleCtx *ctx, LaravelPopArguments *arguments, RedisModuleString *job, double availableAt,
+                               long long *newAttempts, RedisModuleString **storedJob);
+
+typedef struct Options
+{
+    long long iterations;
+    size_t payload;
+    const char *only;
+    int check;
+} Options;
+
+typedef struct Benchmark
+{
+    const char *name;
+    /**
+     * @return the number of operations done.
+     */
+    long long (*run)(RedisModuleCtx *ctx, const Options *options);
+} Benchmark;
+
+static long long nstime(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long) ts.tv_sec * 1000000000ll + ts.tv_nsec;
+}
+
+/**
+ * Time spent in the measured part of the current benchmark.
+ */
+static long long measured;
+static long long measureStartedAt;
+
+#define MEASURE_START() (measureStartedAt = nstime())
+#define MEASURE_STOP() (measured += nstime() - measureStartedAt)
+
+static void freeKeys(RedisModuleCtx *ctx, RedisModuleString **keys, long long n)
+{
+    for (long long i = 0; i < n; ++i) {
+        RedisModule_FreeString(ctx, keys[i]);
+    }
+    free(keys);
+}
+
+/**
+ * A laravel json job of about the payload size.
+ */
+static RedisModuleString * createJob(RedisModuleCtx *ctx, size_t payload, long long id)
+{
+    RedisModuleString *job = RedisModule_CreateStringPrintf(ctx,
+            "{\"uuid\":\"%016llx\",\"displayName\":\"App\\\\Jobs\\\\Bench\",\"job\":\"Illuminate\\\\Queue\\\\CallQueuedHandler@call\","
+            "\"maxTries\":null,\"timeout\":null,\"data\":{\"commandName\":\"App\\\\Jobs\\\\Bench\",\"command\":\"", id);
+    size_t len;
+    RedisModule_StringPtrLen(job, &len);
+    while (len + 20 < payload) {
+        RedisModule_StringAppendBuffer(ctx, job, "x", 1);
+        len++;
+    }
+    RedisModule_StringAppendBuffer(ctx, job, "\"},\"attempts\":0}", 16);
+    return job;
+}
+
+static long long benchmarkDLListPushDelete(RedisModuleCtx *ctx, const Options *options)
+{
+    DLList list = {0, NULL, NULL};
+    DLNode *nodes = calloc((size_t) options->iterations, sizeof(DLNode));
+    MEASURE_START();
+    for (long long i = 0; i < options->iterations; ++i) {
+        DLList_Push_Back(&list, &nodes[i]);
+    }
+    for (long long i = 0; i < options->iterations; ++i) {
+        DLList_Delete(&list, &nodes[i]);
+    }
+    MEASURE_STOP();
+    free(nodes);
+    return 2 * options->iterations;
+}
+
+static long long benchmarkAttemptsScanner(RedisModuleCtx *ctx, const Options *options)
+{
+    RedisModuleString *job = createJob(ctx, options->payload, 1);
+    long long attempts;
+    MEASURE_START();
+    for (long long i = 0; i < options->iterations; ++i) {
+        RedisModule_FreeString(ctx, incrementAttempts(ctx, job, &attempts));
+        if ((i & 1023) == 1023) {
+            MockModule_ResetPool(ctx);
+        }
+    }
+    MEASURE_STOP();
+    MockModule_ResetPool(ctx);
+    RedisModule_FreeString(ctx, job);
+    return options->iterations;
+}
+
+static long long benchmarkAttemptsParser(RedisModuleCtx *ctx, const Options *options)
+{
+    RedisModuleString *job = createJob(ctx, options->payload, 1);
+    size_t len;
+    const char *str = RedisModule_StringPtrLen(job, &len);
+    long long attempts;
+    MEASURE_START();
+    for (long long i = 0; i < options->iterations; ++i) {
+        RedisModule_FreeString(ctx, incrementAttemptsWithParser(ctx, str, len, &attempts));
+        if ((i & 1023) == 1023) {
+            MockModule_ResetPool(ctx);
+        }
+    }
+    MEASURE_STOP();
+    MockModule_ResetPool(ctx);
+    RedisModule_FreeString(ctx, job);
+    return options->iterations;
+}
+
+static long long benchmarkAttemptsEnvelope(RedisModuleCtx *ctx, const Options *options)
+{
+    RedisModuleString *body = createJob(ctx, options->payload, 1);
+    size_t len;
+    const char *str = RedisModule_StringPtrLen(body, &len);
+    char *buffer = malloc(len + JOB_ENVELOPE_HEADER_SIZE);
+    RedisModuleString *job = RedisModule_CreateString(ctx, buffer, writeJobEnvelope(str, len, 0, buffer));
+    free(buffer);
+    long long attempts;
+    MEASURE_START();
+    for (long long i = 0; i < options->iterations; ++i) {
+        RedisModule_FreeString(ctx, incrementAttempts(ctx, job, &attempts));
+        if ((i & 1023) == 1023) {
+            MockModule_ResetPool(ctx);
+        }
+    }
+    MEASURE_STOP();
+    if (attempts != 1) {
+        abort();
+    }
+    MockModule_ResetPool(ctx);
+    RedisModule_FreeString(ctx, job);
+    RedisModule_FreeString(ctx, body);
+    return options->iterations;
+}
+
+static long long benchmarkCompressJob(RedisModuleCtx *ctx, const Options *options)
+{
+    RedisModuleString *job = createJob(ctx, options->payload, 1);
+    long long compressSize = laravelQueueConfig.compressSize;
+    laravelQueueConfig.compressSize = 1;
+    MEASURE_START();
+    for (long long i = 0; i < options->iterations; ++i) {
+        RedisModuleString *compressed = compressJob(ctx, job, NULL);
+        if (compressed) {
+            RedisModule_FreeString(ctx, compressed);
+        }
+    }
+    MEASURE_STOP();
+    laravelQueueConfig.compressSize = compressSize;
+    RedisModule_FreeString(ctx, job);
+    return options->iterations;
+}
+
+static long long benchmarkDecompressJob(RedisModuleCtx *ctx, const Options *options)
+{
+    RedisModuleString *job = createJob(ctx, options->payload, 1);
+    long long compressSize = laravelQueueConfig.compressSize;
+    laravelQueueConfig.compressSize = 1;
+    RedisModuleString *compressed = compressJob(ctx, job, NULL);
+    laravelQueueConfig.compressSize = compressSize;
+    if (! compressed) {
+        compressed = job;
+        RedisModule_RetainString(ctx, compressed);
+    }
+    MEASURE_START();
+    for (long long i = 0; i < options->iterations; ++i) {
+        RedisModuleString *decompressed = decompressJob(ctx, compressed);
+        if (decompressed) {
+            RedisModule_FreeString(ctx, decompressed);
+        }
+    }
+    MEASURE_STOP();
+    RedisModule_FreeString(ctx, compressed);
+    RedisModule_FreeString(ctx, job);
+    return options->iterations;
+}
+
+static long long benchmarkReserveJob(RedisModuleCtx *ctx, const Options *options)
+{
+    RedisModuleString **jobs = malloc(sizeof(RedisModuleString *) * (size_t) options->iterations);
+    for (long long i = 0; i < options->iterations; ++i) {
+        jobs[i] = createJob(ctx, options->payload, i);
+    }
+    LaravelPopArguments arguments;
+    memset(&arguments, 0, sizeof(LaravelPopArguments));
+    arguments.strReserved = RedisModule_CreateString(ctx, "queues:bench:reserved", 21);
+    arguments.reserved = RedisModule_OpenKey(ctx, arguments.strReserved, REDISMODULE_WRITE);
+    double availableAt = 1e9;
+    long long attempts;
+    MEASURE_START();
+    for (long long i = 0; i < options->iterations; ++i) {
+        RedisModule_FreeString(ctx, reserveJob(ctx, &arguments, jobs[i], availableAt + i / 1000.0, &attempts, NULL));
+        if ((i & 1023) == 1023) {
+            MockModule_ResetPool(ctx);
+        }
+    }
+    MEASURE_STOP();
+    MockModule_ResetPool(ctx);
+    RedisModule_CloseKey(arguments.reserved);
+    RedisModule_FreeString(ctx, arguments.strReserved);
+    freeKeys(ctx, jobs, options->iterations);
+    MockModule_FlushAll();
+    return options->iterations;
+}
+
+static long long benchmarkMigrateExpiredJobs(RedisModuleCtx *ctx, const Options *options)
+{
+    RedisModuleString *strList = RedisModule_CreateString(ctx, "queues:bench", 12);
+    RedisModuleString *strZset = RedisModule_CreateString(ctx, "queues:bench:delayed", 20);
+    RedisModuleKey *list = RedisModule_OpenKey(ctx, strList, REDISMODULE_WRITE);
+    RedisModuleKey *zset = RedisModule_OpenKey(ctx, strZset, REDISMODULE_WRITE);
+    for (long long i = 0; i < options->iterations; ++i) {
+        RedisModuleString *job = createJob(ctx, options->payload, i);
+        RedisModule_ZsetAdd(zset, 1e9 + i / 1000.0, job, NULL);
+        RedisModule_FreeString(ctx, job);
+    }
+    double currentTime = (double) ustime() / 1000000;
+    long long migrated = 0, n;
+    QueueStatsCache stats = {NULL, 0};
+    MEASURE_START();
+    do {
+        n = migrateExpiredJobs(ctx, list, strList, currentTime, zset, strZset, ":delayed", &stats);
+        migrated += n;
+        MockModule_ResetPool(ctx);
+    } while (n);
+    MEASURE_STOP();
+    if (migrated != options->iterations) {
+        abort();
+    }
+    RedisModule_CloseKey(list);
+    RedisModule_CloseKey(zset);
+    RedisModule_FreeString(ctx, strList);
+    RedisModule_FreeString(ctx, strZset);
+    MockModule_FlushAll();
+    return migrated;
+}
+
+static uint64_t checkRandomState = 0x9e3779b97f4a7c15ull;
+
+static unsigned char checkRandomByte(void)
+{
+    checkRandomState ^= checkRandomState << 13;
+    checkRandomState ^= checkRandomState >> 7;
+    checkRandomState ^= checkRandomState << 17;
+    return (unsigned char) checkRandomState;
+}
+
+#define CHECK(condition, ...) do { \
+    if (! (condition)) { \
+        fprintf(stderr, "check failed: " __VA_ARGS__); \
+        fputc('\n', stderr); \
+        abort(); \
+    } \
+} while (0)
+
+/**
+ * Fill a buffer with the pattern of a check job: 0 repeats a json-like text, 1 is random, and 2 and 3 repeat a random
+ * block every 65535 and 70000 bytes, i.e. at the largest offset a match can have and beyond it. The block is
+ * separated by a run of a single byte, so the match finder still remembers it when it comes again.
+ */
+static void fillCheckJob(char *job, size_t len, int pattern)
+{
+    static const char text[] = "{\"uuid\":\"5f1c\",\"job\":\"Illuminate\\\\Queue\\\\CallQueuedHandler@call\",\"attempts\":0}";
+    size_t period = pattern == 2 ? 65535 : 70000;
+    for (size_t i = 0; i < len; ++i) {
+        if (pattern == 0) {
+            job[i] = text[i % (sizeof(text) - 1)];
+        } else if (pattern == 1 || i < 1000) {
+            job[i] = (char) checkRandomByte();
+        } else if (i % period < 1000) {
+            job[i] = job[i - period];
+        } else {
+            job[i] = 'z';
+        }
+    }
+    // A job starting with 0xFE is taken for a compressed one, and never compressed.
+    if (len && (unsigned char) job[0] == COMPRESSED_JOB_MAGIC) {
+        job[0] = '{';
+    }
+}
+
+static void * (*checkUntrackedAlloc)(size_t bytes);
+static size_t checkLargestAlloc;
+
+static void * checkTrackedAlloc(size_t bytes)
+{
+    if (bytes > checkLargestAlloc) {
+        checkLargestAlloc = bytes;
+    }
+    return checkUntrackedAlloc(bytes);
+}
+
+/**
+ * Decompressing a corrupt job must fail, or give some job, but never read or write out of bounds, nor allocate more
+ * than the job can decompress to.
+ */
+static void checkCorruptJob(RedisModuleCtx *ctx, const char *compressed, size_t len, int mustFail, const char *what)
+{
+    RedisModuleString *corrupt = RedisModule_CreateString(ctx, compressed, len);
+    checkUntrackedAlloc = RedisModule_Alloc;
+    checkLargestAlloc = 0;
+    RedisModule_Alloc = checkTrackedAlloc;
+    RedisModuleString *decompressed = decompressJob(ctx, corrupt);
+    RedisModule_Alloc = checkUntrackedAlloc;
+    CHECK(! mustFail || ! decompressed, "%s of %zu bytes was decompressed", what, len);
+    CHECK(checkLargestAlloc <= len * 255 + 1, "%s of %zu bytes allocated %zu bytes", what, len, checkLargestAlloc);
+    if (decompressed) {
+        RedisModule_FreeString(ctx, decompressed);
+    }
+    RedisModule_FreeString(ctx, corrupt);
+}
+
+/**
+ * Round trips of compressed jobs of sizes around the limits of the codec, and rejection of truncated and forged ones.
+ */
+static void checkCompression(RedisModuleCtx *ctx)
+{
+    static const size_t sizes[] = {0, 1, 4, 15, 16, 17, 18, 20, 31, 100, 270, 1000, 4096, 65535, 65536, 65537,
+                                   70000, 140001, 300000};
+    long long compressSize = laravelQueueConfig.compressSize;
+    laravelQueueConfig.compressSize = 1;
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(size_t); ++s) {
+        for (int pattern = 0; pattern < 4; ++pattern) {
+            size_t len = sizes[s];
+            char *buffer = malloc(len ? len : 1);
+            fillCheckJob(buffer, len, pattern);
+            RedisModuleString *job = RedisModule_CreateString(ctx, buffer, len);
+            RedisModuleString *compressed = compressJob(ctx, job, NULL);
+            int compressible = (pattern == 0 && len >= 100) || (pattern >= 2 && len >= 2000);
+            CHECK(compressed || ! compressible, "pattern %d of %zu bytes was not compressed", pattern, len);
+            if (! compressed) {
+                RedisModule_FreeString(ctx, job);
+                free(buffer);
+                continue;
+            }
+            size_t compressedLen;
+            const char *str = RedisModule_StringPtrLen(compressed, &compressedLen);
+            CHECK(compressedLen < len && isCompressedJob(str, compressedLen), "pattern %d of %zu bytes got longer",
+                  pattern, len);
+            RedisModuleString *decompressed = decompressJob(ctx, compressed);
+            CHECK(decompressed && RedisModule_StringCompare(decompressed, job) == 0,
+                  "pattern %d of %zu bytes changed in a round trip", pattern, len);
+            RedisModule_FreeString(ctx, decompressed);
+
+            // Every truncation of a small job, and a few hundred of a large one.
+            size_t step = compressedLen / 300 + 1;
+            for (size_t cut = 0; cut < compressedLen; cut += step) {
+                checkCorruptJob(ctx, str, cut, cut >= COMPRESSED_JOB_HEADER_SIZE, "a truncated job");
+            }
+            char *forged = malloc(compressedLen);
+            long long lengths[] = {(long long) len - 1, (long long) len + 1, 0xffffffffll};
+            for (size_t i = 0; i < sizeof(lengths) / sizeof(long long); ++i) {
+                memcpy(forged, str, compressedLen);
+                for (int b = 0; b < 4; ++b) {
+                    forged[1 + b] = (char) (lengths[i] >> (8 * (3 - b)));
+                }
+                checkCorruptJob(ctx, forged, compressedLen, lengths[i] >= 0, "a job with a forged length");
+            }
+            for (int i = 0; i < 100; ++i) {
+                memcpy(forged, str, compressedLen);
+                size_t at = COMPRESSED_JOB_HEADER_SIZE +
+                            (size_t) checkRandomState % (compressedLen - COMPRESSED_JOB_HEADER_SIZE);
+                forged[at] = (char) checkRandomByte();
+                checkCorruptJob(ctx, forged, compressedLen, 0, "a job with a random byte");
+            }
+            free(forged);
+            RedisModule_FreeString(ctx, compressed);
+            RedisModule_FreeString(ctx, job);
+            free(buffer);
+        }
+    }
+    laravelQueueConfig.compressSize = compressSize;
+    printf("{\"check\":\"compression\",\"ok\":true}\n");
+}
+
+static const Benchmark benchmarks[] = {
+        {"dllist-push-delete", benchmarkDLListPushDelete},
+        {"attempts-scanner", benchmarkAttemptsScanner},
+        {"attempts-parser", benchmarkAttemptsParser},
+        {"attempts-envelope", benchmarkAttemptsEnvelope},
+        {"compress-job", benchmarkCompressJob},
+        {"decompress-job", benchmarkDecompressJob},
+        {"reserve-job", benchmarkReserveJob},
+        {"migrate-expired-jobs", benchmarkMigrateExpiredJobs},
+};
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "Usage: laravelq-microbench [options]\n"
+            "  --iterations <n>   operations per benchmark (default 100000)\n"
+            "  --payload <bytes>  size of the jobs (default 1000)\n"
+            "  --only <name>      run a single benchmark\n"
+            "  --check            verify the stored formats instead, aborting on the first failure\n");
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    Options options = {100000, 1000, NULL, 0};
+    for (int i = 1; i < argc; ++i) {
+        if (! strcmp(argv[i], "--check")) {
+            options.check = 1;
+        } else if (i + 1 == argc) {
+            usage();
+        } else if (! strcmp(argv[i], "--iterations")) {
+            options.iterations = atoll(argv[++i]);
+        } else if (! strcmp(argv[i], "--payload")) {
+            options.payload = (size_t) atoll(argv[++i]);
+        } else if (! strcmp(argv[i], "--only")) {
+            options.only = argv[++i];
+        } else {
+            usage();
+        }
+    }
+    if (options.iterations < 1) {
+        usage();
+    }
+
+    RedisModuleCtx *ctx = MockModule_Init();
+    setupMemoryManagement();
+    initJobAttempts();
+    initWaitingList();
+    if (options.check) {
+        checkCompression(ctx);
+        return 0;
+    }
+    for (size_t i = 0; i < sizeof(benchmarks) / sizeof(Benchmark); ++i) {
+        if (options.only && strcmp(options.only, benchmarks[i].name)) {
+            continue;
+        }
+        measured = 0;
+        long long ops = benchmarks[i].run(ctx, &options);
+        printf("{\"benchmark\":\"%s\",\"payload\":%zu,\"ops\":%lld,\"ns_per_op\":%.1f}\n",
+               benchmarks[i].name, options.payload, ops, (double) measured / ops);
+        fflush(stdout);
+    }
+    return 0;
+}
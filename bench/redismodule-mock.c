@@ -0,0 +1,901 @@
+/*
+ * Copyright (c) 2018, Hamid Alaei Varnosfaderani
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "redismodule-mock.h"
+
+#define MOCK_POOL_BLOCK_SIZE (64 * 1024)
+
+typedef struct MockPoolBlock
+{
+    struct MockPoolBlock *next;
+    size_t used;
+    size_t size;
+    char data[];
+} MockPoolBlock;
+
+struct RedisModuleCtx
+{
+    MockPoolBlock *pool;
+    long long replies;
+};
+
+struct RedisModuleString
+{
+    int refcount;
+    size_t len;
+    char *ptr;
+};
+
+/* ------------------------------------------------------------------------------------------------------------------
+ * Memory
+ * --------------------------------------------------------------------------------------------------------------- */
+
+static void * mockAlloc(size_t bytes)
+{
+    void *ptr = malloc(bytes);
+    if (! ptr) {
+        abort();
+    }
+    return ptr;
+}
+
+static void * mockCalloc(size_t nmemb, size_t size)
+{
+    void *ptr = calloc(nmemb, size);
+    if (! ptr) {
+        abort();
+    }
+    return ptr;
+}
+
+static void * mockRealloc(void *ptr, size_t bytes)
+{
+    ptr = realloc(ptr, bytes);
+    if (! ptr) {
+        abort();
+    }
+    return ptr;
+}
+
+static void mockFree(void *ptr)
+{
+    free(ptr);
+}
+
+static void * mockPoolAlloc(RedisModuleCtx *ctx, size_t bytes)
+{
+    bytes = (bytes + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+    MockPoolBlock *block = ctx->pool;
+    if (! block || block->size - block->used < bytes) {
+        size_t size = bytes > MOCK_POOL_BLOCK_SIZE ? bytes : MOCK_POOL_BLOCK_SIZE;
+        block = mockAlloc(sizeof(MockPoolBlock) + size);
+        block->size = size;
+        block->used = 0;
+        block->next = ctx->pool;
+        ctx->pool = block;
+    }
+    void *ptr = block->data + block->used;
+    block->used += bytes;
+    return ptr;
+}
+
+void MockModule_ResetPool(RedisModuleCtx *ctx)
+{
+    while (ctx->pool) {
+        MockPoolBlock *next = ctx->pool->next;
+        free(ctx->pool);
+        ctx->pool = next;
+    }
+}
+
+/* ------------------------------------------------------------------------------------------------------------------
+ * Strings
+ * --------------------------------------------------------------------------------------------------------------- */
+
+static RedisModuleString * mockCreateString(RedisModuleCtx *ctx, const char *ptr, size_t len)
+{
+    RedisModuleString *str = mockAlloc(sizeof(RedisModuleString));
+    str->refcount = 1;
+    str->len = len;
+    str->ptr = mockAlloc(len + 1);
+    memcpy(str->ptr, ptr, len);
+    str->ptr[len] = 0;
+    return str;
+}
+
+static RedisModuleString * mockCreateStringFromString(RedisModuleCtx *ctx, const RedisModuleString *str)
+{
+    return mockCreateString(ctx, str->ptr, str->len);
+}
+
+static RedisModuleString * mockCreateStringPrintf(RedisModuleCtx *ctx, const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    int len = vsnprintf(NULL, 0, fmt, ap);
+    va_end(ap);
+    RedisModuleString *str = mockCreateString(ctx, "", 0);
+    str->ptr = mockRealloc(str->ptr, (size_t) len + 1);
+    va_start(ap, fmt);
+    vsnprintf(str->ptr, (size_t) len + 1, fmt, ap);
+    va_end(ap);
+    str->len = (size_t) len;
+    return str;
+}
+
+static void mockFreeString(RedisModuleCtx *ctx, RedisModuleString *str)
+{
+    if (--str->refcount == 0) {
+        free(str->ptr);
+        free(str);
+    }
+}
+
+static void mockRetainString(RedisModuleCtx *ctx, RedisModuleString *str)
+{
+    str->refcount++;
+}
+
+static const char * mockStringPtrLen(const RedisModuleString *str, size_t *len)
+{
+    if (len) {
+        *len = str->len;
+    }
+    return str->ptr;
+}
+
+static int compareBuffers(const char *a, size_t alen, const char *b, size_t blen)
+{
+    int cmp = memcmp(a, b, alen < blen ? alen : blen);
+    if (cmp) {
+        return cmp;
+    }
+    return alen < blen ? -1 : alen > blen;
+}
+
+static int mockStringCompare(RedisModuleString *a, RedisModuleString *b)
+{
+    return compareBuffers(a->ptr, a->len, b->ptr, b->len);
+}
+
+static int mockStringToLongLong(const RedisModuleString *str, long long *ll)
+{
+    char *end;
+    if (! str->len) {
+        return REDISMODULE_ERR;
+    }
+    *ll = strtoll(str->ptr, &end, 10);
+    return end == str->ptr + str->len ? REDISMODULE_OK : REDISMODULE_ERR;
+}
+
+static int mockStringToDouble(const RedisModuleString *str, double *d)
+{
+    char *end;
+    if (! str->len) {
+        return REDISMODULE_ERR;
+    }
+    *d = strtod(str->ptr, &end);
+    return end == str->ptr + str->len ? REDISMODULE_OK : REDISMODULE_ERR;
+}
+
+static int mockStringAppendBuffer(RedisModuleCtx *ctx, RedisModuleString *str, const char *buf, size_t len)
+{
+    str->ptr = mockRealloc(str->ptr, str->len + len + 1);
+    memcpy(str->ptr + str->len, buf, len);
+    str->len += len;
+    str->ptr[str->len] = 0;
+    return REDISMODULE_OK;
+}
+
+/* ------------------------------------------------------------------------------------------------------------------
+ * Dictionaries, as chained hash tables. Unlike the server, iteration is not in the order of the keys.
+ * --------------------------------------------------------------------------------------------------------------- */
+
+typedef struct MockDictEntry
+{
+    struct MockDictEntry *next;
+    void *value;
+    uint64_t hash;
+    size_t keylen;
+    char key[];
+} MockDictEntry;
+
+struct RedisModuleDict
+{
+    MockDictEntry **buckets;
+    size_t capacity;
+    uint64_t size;
+};
+
+struct RedisModuleDictIter
+{
+    RedisModuleDict *dict;
+    size_t bucket;
+    MockDictEntry *entry;
+};
+
+static uint64_t hashOf(const char *key, size_t keylen)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < keylen; ++i) {
+        hash = (hash ^ (unsigned char) key[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+static RedisModuleDict * mockCreateDict(RedisModuleCtx *ctx)
+{
+    RedisModuleDict *d = mockAlloc(sizeof(RedisModuleDict));
+    d->capacity = 16;
+    d->size = 0;
+    d->buckets = mockCalloc(d->capacity, sizeof(MockDictEntry *));
+    return d;
+}
+
+static void mockFreeDict(RedisModuleCtx *ctx, RedisModuleDict *d)
+{
+    for (size_t i = 0; i < d->capacity; ++i) {
+        MockDictEntry *entry = d->buckets[i];
+        while (entry) {
+            MockDictEntry *next = entry->next;
+            free(entry);
+            entry = next;
+        }
+    }
+    free(d->buckets);
+    free(d);
+}
+
+static MockDictEntry ** findEntry(RedisModuleDict *d, const char *key, size_t keylen, uint64_t hash)
+{
+    MockDictEntry **entry = &d->buckets[hash & (d->capacity - 1)];
+    while (*entry && ((*entry)->hash != hash || (*entry)->keylen != keylen || memcmp((*entry)->key, key, keylen))) {
+        entry = &(*entry)->next;
+    }
+    return entry;
+}
+
+static void growDict(RedisModuleDict *d)
+{
+    size_t capacity = d->capacity * 2;
+    MockDictEntry **buckets = mockCalloc(capacity, sizeof(MockDictEntry *));
+    for (size_t i = 0; i < d->capacity; ++i) {
+        MockDictEntry *entry = d->buckets[i];
+        while (entry) {
+            MockDictEntry *next = entry->next;
+            entry->next = buckets[entry->hash & (capacity - 1)];
+            buckets[entry->hash & (capacity - 1)] = entry;
+            entry = next;
+        }
+    }
+    free(d->buckets);
+    d->buckets = buckets;
+    d->capacity = capacity;
+}
+
+static int mockDictSetC(RedisModuleDict *d, void *key, size_t keylen, void *ptr)
+{
+    uint64_t hash = hashOf(key, keylen);
+    MockDictEntry **slot = findEntry(d, key, keylen, hash);
+    if (*slot) {
+        return REDISMODULE_ERR;
+    }
+    MockDictEntry *entry = mockAlloc(sizeof(MockDictEntry) + keylen);
+    entry->next = NULL;
+    entry->value = ptr;
+    entry->hash = hash;
+    entry->keylen = keylen;
+    memcpy(entry->key, key, keylen);
+    *slot = entry;
+    if (++d->size > d->capacity) {
+        growDict(d);
+    }
+    return REDISMODULE_OK;
+}
+
+static int mockDictSet(RedisModuleDict *d, RedisModuleString *key, void *ptr)
+{
+    return mockDictSetC(d, key->ptr, key->len, ptr);
+}
+
+static void * mockDictGetC(RedisModuleDict *d, void *key, size_t keylen, int *nokey)
+{
+    MockDictEntry *entry = *findEntry(d, key, keylen, hashOf(key, keylen));
+    if (nokey) {
+        *nokey = entry == NULL;
+    }
+    return entry ? entry->value : NULL;
+}
+
+static void * mockDictGet(RedisModuleDict *d, RedisModuleString *key, int *nokey)
+{
+    return mockDictGetC(d, key->ptr, key->len, nokey);
+}
+
+static int mockDictDelC(RedisModuleDict *d, void *key, size_t keylen, void *oldval)
+{
+    MockDictEntry **slot = findEntry(d, key, keylen, hashOf(key, keylen));
+    MockDictEntry *entry = *slot;
+    if (! entry) {
+        return REDISMODULE_ERR;
+    }
+    if (oldval) {
+        *(void **) oldval = entry->value;
+    }
+    *slot = entry->next;
+    free(entry);
+    d->size--;
+    return REDISMODULE_OK;
+}
+
+static int mockDictDel(RedisModuleDict *d, RedisModuleString *key, void *oldval)
+{
+    return mockDictDelC(d, key->ptr, key->len, oldval);
+}
+
+static uint64_t mockDictSize(RedisModuleDict *d)
+{
+    return d->size;
+}
+
+static RedisModuleDictIter * mockDictIteratorStartC(RedisModuleDict *d, const char *op, void *key, size_t keylen)
+{
+    if (strcmp(op, "^") != 0) {
+        fprintf(stderr, "mock: only the ^ dictionary iterator is supported\n");
+        abort();
+    }
+    RedisModuleDictIter *di = mockAlloc(sizeof(RedisModuleDictIter));
+    di->dict = d;
+    di->bucket = 0;
+    di->entry = NULL;
+    return di;
+}
+
+static void * mockDictNextC(RedisModuleDictIter *di, size_t *keylen, void **dataptr)
+{
+    if (di->entry) {
+        di->entry = di->entry->next;
+    }
+    while (! di->entry && di->bucket < di->dict->capacity) {
+        di->entry = di->dict->buckets[di->bucket++];
+    }
+    if (! di->entry) {
+        return NULL;
+    }
+    if (keylen) {
+        *keylen = di->entry->keylen;
+    }
+    if (dataptr) {
+        *dataptr = di->entry->value;
+    }
+    return di->entry->key;
+}
+
+static void mockDictIteratorStop(RedisModuleDictIter *di)
+{
+    free(di);
+}
+
+/* ------------------------------------------------------------------------------------------------------------------
+ * Keyspace of lists and sorted sets
+ * --------------------------------------------------------------------------------------------------------------- */
+
+typedef struct MockZsetEntry
+{
+    double score;
+    RedisModuleString *ele;
+} MockZsetEntry;
+
+/**
+ * A list is an array of strings, and a sorted set is an array of entries sorted by score and element,
+ * with a dictionary of the scores. Both leave room at the head, so popping the front is constant time.
+ */
+typedef struct MockValue
+{
+    int type;
+    void *items;
+    size_t head;
+    size_t size;
+    size_t capacity;
+    RedisModuleDict *scores;
+} MockValue;
+
+struct RedisModuleKey
+{
+    RedisModuleString *name;
+    MockValue *value;
+    size_t rangeIndex;
+    double rangeMax;
+    int rangeMaxEx;
+    int rangeEnd;
+};
+
+static RedisModuleDict *keyspace;
+static long long replicated;
+
+static size_t itemSize(MockValue *value)
+{
+    return value->type == REDISMODULE_KEYTYPE_LIST ? sizeof(RedisModuleString *) : sizeof(MockZsetEntry);
+}
+
+static char * itemAt(MockValue *value, size_t index)
+{
+    return (char *) value->items + (value->head + index) * itemSize(value);
+}
+
+/**
+ * Make room for an item at an index.
+ */
+static void insertItem(MockValue *value, size_t index)
+{
+    size_t size = itemSize(value);
+    if (index == 0 && value->head > 0) {
+        value->head--;
+    } else {
+        if (value->head + value->size == value->capacity) {
+            if (value->head > value->capacity / 2) {
+                memmove(value->items, itemAt(value, 0), value->size * size);
+                value->head = 0;
+            } else {
+                value->capacity = value->capacity ? value->capacity * 2 : 16;
+                value->items = mockRealloc(value->items, value->capacity * size);
+            }
+        }
+        memmove(itemAt(value, index + 1), itemAt(value, index), (value->size - index) * size);
+    }
+    value->size++;
+}
+
+static void removeItem(MockValue *value, size_t index)
+{
+    if (index == 0) {
+        value->head++;
+    } else {
+        memmove(itemAt(value, index), itemAt(value, index + 1), (value->size - index - 1) * itemSize(value));
+    }
+    value->size--;
+}
+
+static void freeValue(MockValue *value)
+{
+    for (size_t i = 0; i < value->size; ++i) {
+        if (value->type == REDISMODULE_KEYTYPE_LIST) {
+            mockFreeString(NULL, *(RedisModuleString **) itemAt(value, i));
+        } else {
+            MockZsetEntry *entry = (MockZsetEntry *) itemAt(value, i);
+            free(mockDictGet(value->scores, entry->ele, NULL));
+            mockFreeString(NULL, entry->ele);
+        }
+    }
+    if (value->scores) {
+        mockFreeDict(NULL, value->scores);
+    }
+    free(value->items);
+    free(value);
+}
+
+static MockValue * createValue(RedisModuleKey *key, int type)
+{
+    if (! key->value) {
+        key->value = mockCalloc(1, sizeof(MockValue));
+        key->value->type = type;
+        if (type == REDISMODULE_KEYTYPE_ZSET) {
+            key->value->scores = mockCreateDict(NULL);
+        }
+        mockDictSet(keyspace, key->name, key->value);
+    }
+    return key->value->type == type ? key->value : NULL;
+}
+
+static int mockDeleteKey(RedisModuleKey *key)
+{
+    if (key->value) {
+        mockDictDel(keyspace, key->name, NULL);
+        freeValue(key->value);
+        key->value = NULL;
+    }
+    return REDISMODULE_OK;
+}
+
+/**
+ * Empty values are deleted, as the server does.
+ */
+static void deleteIfEmpty(RedisModuleKey *key)
+{
+    if (key->value && ! key->value->size) {
+        mockDeleteKey(key);
+    }
+}
+
+void MockModule_FlushAll(void)
+{
+    RedisModuleDictIter *di = mockDictIteratorStartC(keyspace, "^", NULL, 0);
+    MockValue *value;
+    while (mockDictNextC(di, NULL, (void **) &value)) {
+        freeValue(value);
+    }
+    mockDictIteratorStop(di);
+    mockFreeDict(NULL, keyspace);
+    keyspace = mockCreateDict(NULL);
+}
+
+static void * mockOpenKey(RedisModuleCtx *ctx, RedisModuleString *keyname, int mode)
+{
+    RedisModuleKey *key = mockCalloc(1, sizeof(RedisModuleKey));
+    key->name = mockCreateStringFromString(ctx, keyname);
+    key->value = mockDictGet(keyspace, keyname, NULL);
+    return key;
+}
+
+static void mockCloseKey(RedisModuleKey *key)
+{
+    if (key) {
+        mockFreeString(NULL, key->name);
+        free(key);
+    }
+}
+
+static int mockKeyType(RedisModuleKey *key)
+{
+    return key->value ? key->value->type : REDISMODULE_KEYTYPE_EMPTY;
+}
+
+static size_t mockValueLength(RedisModuleKey *key)
+{
+    return key->value ? key->value->size : 0;
+}
+
+static int mockListPush(RedisModuleKey *key, int where, RedisModuleString *ele)
+{
+    MockValue *list = createValue(key, REDISMODULE_KEYTYPE_LIST);
+    if (! list) {
+        return REDISMODULE_ERR;
+    }
+    size_t index = where == REDISMODULE_LIST_HEAD ? 0 : list->size;
+    insertItem(list, index);
+    *(RedisModuleString **) itemAt(list, index) = mockCreateStringFromString(NULL, ele);
+    return REDISMODULE_OK;
+}
+
+static RedisModuleString * mockListPop(RedisModuleKey *key, int where)
+{
+    MockValue *list = key->value;
+    if (! list || list->type != REDISMODULE_KEYTYPE_LIST) {
+        return NULL;
+    }
+    size_t index = where == REDISMODULE_LIST_HEAD ? 0 : list->size - 1;
+    RedisModuleString *ele = *(RedisModuleString **) itemAt(list, index);
+    removeItem(list, index);
+    deleteIfEmpty(key);
+    return ele;
+}
+
+static int compareZsetEntry(const MockZsetEntry *entry, double score, RedisModuleString *ele)
+{
+    if (entry->score != score) {
+        return entry->score < score ? -1 : 1;
+    }
+    return mockStringCompare(entry->ele, ele);
+}
+
+/**
+ * Index of the first entry not less than (score, ele).
+ */
+static size_t zsetLowerBound(MockValue *zset, double score, RedisModuleString *ele)
+{
+    size_t low = 0, high = zset->size;
+    while (low < high) {
+        size_t mid = (low + high) / 2;
+        MockZsetEntry *entry = (MockZsetEntry *) itemAt(zset, mid);
+        if (ele ? compareZsetEntry(entry, score, ele) < 0 : entry->score < score) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+static int mockZsetRem(RedisModuleKey *key, RedisModuleString *ele, int *deleted)
+{
+    MockValue *zset = key->value;
+    if (deleted) {
+        *deleted = 0;
+    }
+    if (! zset) {
+        return REDISMODULE_OK;
+    }
+    if (zset->type != REDISMODULE_KEYTYPE_ZSET) {
+        return REDISMODULE_ERR;
+    }
+    double *score = mockDictGet(zset->scores, ele, NULL);
+    if (! score) {
+        return REDISMODULE_OK;
+    }
+    size_t index = zsetLowerBound(zset, *score, ele);
+    MockZsetEntry *entry = (MockZsetEntry *) itemAt(zset, index);
+    mockFreeString(NULL, entry->ele);
+    removeItem(zset, index);
+    mockDictDel(zset->scores, ele, NULL);
+    free(score);
+    if (deleted) {
+        *deleted = 1;
+    }
+    deleteIfEmpty(key);
+    return REDISMODULE_OK;
+}
+
+static int mockZsetAdd(RedisModuleKey *key, double score, RedisModuleString *ele, int *flagsptr)
+{
+    MockValue *zset = createValue(key, REDISMODULE_KEYTYPE_ZSET);
+    if (! zset) {
+        return REDISMODULE_ERR;
+    }
+    double *stored = mockDictGet(zset->scores, ele, NULL);
+    if (stored) {
+        size_t index = zsetLowerBound(zset, *stored, ele);
+        mockFreeString(NULL, ((MockZsetEntry *) itemAt(zset, index))->ele);
+        removeItem(zset, index);
+    } else {
+        stored = mockAlloc(sizeof(double));
+        mockDictSet(zset->scores, ele, stored);
+    }
+    *stored = score;
+    size_t index = zsetLowerBound(zset, score, ele);
+    insertItem(zset, index);
+    MockZsetEntry *entry = (MockZsetEntry *) itemAt(zset, index);
+    entry->score = score;
+    entry->ele = mockCreateStringFromString(NULL, ele);
+    if (flagsptr) {
+        *flagsptr = REDISMODULE_ZADD_ADDED;
+    }
+    return REDISMODULE_OK;
+}
+
+static int inRange(RedisModuleKey *key)
+{
+    if (key->rangeIndex >= key->value->size) {
+        return 0;
+    }
+    double score = ((MockZsetEntry *) itemAt(key->value, key->rangeIndex))->score;
+    return key->rangeMaxEx ? score < key->rangeMax : score <= key->rangeMax;
+}
+
+static int mockZsetFirstInScoreRange(RedisModuleKey *key, double min, double max, int minex, int maxex)
+{
+    if (! key->value || key->value->type != REDISMODULE_KEYTYPE_ZSET) {
+        return REDISMODULE_ERR;
+    }
+    size_t index = zsetLowerBound(key->value, min, NULL);
+    while (minex && index < key->value->size && ((MockZsetEntry *) itemAt(key->value, index))->score == min) {
+        index++;
+    }
+    key->rangeIndex = index;
+    key->rangeMax = max;
+    key->rangeMaxEx = maxex;
+    key->rangeEnd = ! inRange(key);
+    return REDISMODULE_OK;
+}
+
+static RedisModuleString * mockZsetRangeCurrentElement(RedisModuleKey *key, double *score)
+{
+    if (key->rangeEnd) {
+        return NULL;
+    }
+    MockZsetEntry *entry = (MockZsetEntry *) itemAt(key->value, key->rangeIndex);
+    if (score) {
+        *score = entry->score;
+    }
+    return mockCreateStringFromString(NULL, entry->ele);
+}
+
+static int mockZsetRangeNext(RedisModuleKey *key)
+{
+    if (key->rangeEnd) {
+        return 0;
+    }
+    key->rangeIndex++;
+    key->rangeEnd = ! inRange(key);
+    return ! key->rangeEnd;
+}
+
+static int mockZsetRangeEndReached(RedisModuleKey *key)
+{
+    return key->rangeEnd;
+}
+
+static void mockZsetRangeStop(RedisModuleKey *key)
+{
+    key->rangeEnd = 1;
+}
+
+/* ------------------------------------------------------------------------------------------------------------------
+ * Replication, replies, timers and logging
+ * --------------------------------------------------------------------------------------------------------------- */
+
+static int mockReplicate(RedisModuleCtx *ctx, const char *cmdname, const char *fmt, ...)
+{
+    replicated++;
+    return REDISMODULE_OK;
+}
+
+static int mockReplicateVerbatim(RedisModuleCtx *ctx)
+{
+    replicated++;
+    return REDISMODULE_OK;
+}
+
+long long MockModule_Replicated(void)
+{
+    return replicated;
+}
+
+static int mockGetSelectedDb(RedisModuleCtx *ctx)
+{
+    return 0;
+}
+
+static RedisModuleTimerID mockCreateTimer(RedisModuleCtx *ctx, mstime_t period, RedisModuleTimerProc callback,
+                                          void *data)
+{
+    static RedisModuleTimerID timers;
+    return ++timers;
+}
+
+static int mockStopTimer(RedisModuleCtx *ctx, RedisModuleTimerID id, void **data)
+{
+    return REDISMODULE_OK;
+}
+
+static void mockLog(RedisModuleCtx *ctx, const char *level, const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    fprintf(stderr, "mock %s: ", level);
+    vfprintf(stderr, fmt, ap);
+    fprintf(stderr, "\n");
+    va_end(ap);
+}
+
+static int mockReplyWithArray(RedisModuleCtx *ctx, long len)
+{
+    ctx->replies++;
+    return REDISMODULE_OK;
+}
+
+static void mockReplySetArrayLength(RedisModuleCtx *ctx, long len)
+{
+}
+
+static int mockReplyWithError(RedisModuleCtx *ctx, const char *err)
+{
+    ctx->replies++;
+    return REDISMODULE_OK;
+}
+
+static int mockReplyWithLongLong(RedisModuleCtx *ctx, long long ll)
+{
+    ctx->replies++;
+    return REDISMODULE_OK;
+}
+
+static int mockReplyWithNull(RedisModuleCtx *ctx)
+{
+    ctx->replies++;
+    return REDISMODULE_OK;
+}
+
+static int mockReplyWithSimpleString(RedisModuleCtx *ctx, const char *msg)
+{
+    ctx->replies++;
+    return REDISMODULE_OK;
+}
+
+static int mockReplyWithString(RedisModuleCtx *ctx, RedisModuleString *str)
+{
+    ctx->replies++;
+    return REDISMODULE_OK;
+}
+
+static int mockReplyWithStringBuffer(RedisModuleCtx *ctx, const char *buf, size_t len)
+{
+    ctx->replies++;
+    return REDISMODULE_OK;
+}
+
+RedisModuleCtx * MockModule_Init(void)
+{
+    RedisModule_Alloc = mockAlloc;
+    RedisModule_Calloc = mockCalloc;
+    RedisModule_Realloc = mockRealloc;
+    RedisModule_Free = mockFree;
+    RedisModule_PoolAlloc = mockPoolAlloc;
+
+    RedisModule_CreateString = mockCreateString;
+    RedisModule_CreateStringFromString = mockCreateStringFromString;
+    RedisModule_CreateStringPrintf = mockCreateStringPrintf;
+    RedisModule_FreeString = mockFreeString;
+    RedisModule_RetainString = mockRetainString;
+    RedisModule_StringPtrLen = mockStringPtrLen;
+    RedisModule_StringCompare = mockStringCompare;
+    RedisModule_StringToLongLong = mockStringToLongLong;
+    RedisModule_StringToDouble = mockStringToDouble;
+    RedisModule_StringAppendBuffer = mockStringAppendBuffer;
+
+    RedisModule_CreateDict = mockCreateDict;
+    RedisModule_FreeDict = mockFreeDict;
+    RedisModule_DictSet = mockDictSet;
+    RedisModule_DictSetC = mockDictSetC;
+    RedisModule_DictGet = mockDictGet;
+    RedisModule_DictGetC = mockDictGetC;
+    RedisModule_DictDel = mockDictDel;
+    RedisModule_DictDelC = mockDictDelC;
+    RedisModule_DictSize = mockDictSize;
+    RedisModule_DictIteratorStartC = mockDictIteratorStartC;
+    RedisModule_DictNextC = mockDictNextC;
+    RedisModule_DictIteratorStop = mockDictIteratorStop;
+
+    RedisModule_OpenKey = mockOpenKey;
+    RedisModule_CloseKey = mockCloseKey;
+    RedisModule_KeyType = mockKeyType;
+    RedisModule_ValueLength = mockValueLength;
+    RedisModule_DeleteKey = mockDeleteKey;
+    RedisModule_ListPush = mockListPush;
+    RedisModule_ListPop = mockListPop;
+    RedisModule_ZsetAdd = mockZsetAdd;
+    RedisModule_ZsetRem = mockZsetRem;
+    RedisModule_ZsetFirstInScoreRange = mockZsetFirstInScoreRange;
+    RedisModule_ZsetRangeCurrentElement = mockZsetRangeCurrentElement;
+    RedisModule_ZsetRangeNext = mockZsetRangeNext;
+    RedisModule_ZsetRangeEndReached = mockZsetRangeEndReached;
+    RedisModule_ZsetRangeStop = mockZsetRangeStop;
+
+    RedisModule_Replicate = mockReplicate;
+    RedisModule_ReplicateVerbatim = mockReplicateVerbatim;
+    RedisModule_GetSelectedDb = mockGetSelectedDb;
+    RedisModule_CreateTimer = mockCreateTimer;
+    RedisModule_StopTimer = mockStopTimer;
+    RedisModule_Log = mockLog;
+    RedisModule_ReplyWithArray = mockReplyWithArray;
+    RedisModule_ReplySetArrayLength = mockReplySetArrayLength;
+    RedisModule_ReplyWithError = mockReplyWithError;
+    RedisModule_ReplyWithLongLong = mockReplyWithLongLong;
+    RedisModule_ReplyWithNull = mockReplyWithNull;
+    RedisModule_ReplyWithSimpleString = mockReplyWithSimpleString;
+    RedisModule_ReplyWithString = mockReplyWithString;
+    RedisModule_ReplyWithStringBuffer = mockReplyWithStringBuffer;
+
+    keyspace = mockCreateDict(NULL);
+    return mockCalloc(1, sizeof(RedisModuleCtx));
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2018, Hamid Alaei Varnosfaderani
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LARAVEL_QUEUE_REDISMODULE_MOCK_H
+#define LARAVEL_QUEUE_REDISMODULE_MOCK_H
+
+#include "../src/redismodule.h"
+
+/**
+ * In-process stand-in of the module API, to run the module sources without a server.
+ *
+ * Strings, dictionaries, lists and sorted sets are backed by simple structures, the keyspace is a single database,
+ * replication and replies are only counted, and timers never fire. Only the functions the module calls are mocked;
+ * calling any other one crashes on a NULL pointer.
+ */
+
+/**
+ * Install the mock functions in the RedisModule_* pointers.
+ *
+ * @return a context to pass to the module functions.
+ */
+RedisModuleCtx * MockModule_Init(void);
+
+/**
+ * Free the memory taken by RedisModule_PoolAlloc, like the server does after a command returns.
+ *
+ * @param ctx
+ */
+void MockModule_ResetPool(RedisModuleCtx *ctx);
+
+/**
+ * Delete all the keys.
+ */
+void MockModule_FlushAll(void);
+
+/**
+ * Number of commands replicated so far.
+ */
+long long MockModule_Replicated(void);
+
+#endif //LARAVEL_QUEUE_REDISMODULE_MOCK_H
@@ -33,24 +33,121 @@
 #include "redismodule.h"
 #include "blocking-pop.h"
 #include "containers.h"
+#include "slab.h"
+#include "stats.h"
+#include "latency.h"
+
+#define NOT_SCHEDULED ((size_t) -1)
+
+#define LARAVEL_MAX_KEY_TO_MIGRATE 100
+
+/**
+ * Time budget of draining in each timer callback, in microseconds.
+ */
+#define LARAVEL_DRAIN_BUDGET 1000
+
+/**
+ * A delayed/reserved sorted set with jobs that will be available at a due time.
+ */
+typedef struct ScheduledZset
+{
+    RedisModuleString *strList;
+    RedisModuleString *strZset;
+    char suffix[10];
+    double availableAt;
+
+    /**
+     * Position in the schedule heap, or NOT_SCHEDULED.
+     */
+    size_t index;
+
+    /**
+     * Whether the scheduler is migrating its jobs right now.
+     */
+    char firing;
+
+    /**
+     * Whether a backlog of expired jobs is being migrated in successive timer callbacks.
+     */
+    char draining;
+    long long drained;
+    long long drainStartedAt;
+
+    /**
+     * The counters of the queue, looked up on first use.
+     */
+    QueueStatsCache stats;
+} ScheduledZset;
+
+/**
+ * FIFO of the clients blocked on a queue, longest waiting first.
+ */
+typedef struct WaitingList
+{
+    DLList clients;
+
+    /**
+     * Interned queue names, shared by the waiting clients.
+     */
+    RedisModuleString *strList;
+    RedisModuleString *strDelayed;
+    RedisModuleString *strReserved;
+} WaitingList;
+
+/**
+ * Open addressing hash table with linear probing.
+ */
+typedef struct BlockedClientTable
+{
+    RedisModuleBlockedClient **keys;
+    LaravelPopArguments **values;
+    size_t size;
+    size_t capacity;
+} BlockedClientTable;
 
 typedef struct BlockingPopDS
 {
+    int db;
+
     /**
-     * Dictionary [blocked client => list string]
+     * Hash table [blocked client => LaravelPopArguments]
      */
-    RedisModuleDict *blockedClients;
+    BlockedClientTable blockedClients;
 
     /**
-     * Dictionary[list strings => waiting list DLDictionary[list string => ClientArgumentPair]]
-     * Each WorkerList is a DLDictionary (sting list => ClientArgumentPair)
+     * Dictionary[list strings => WaitingList]
+     * A waiting list is freed when its last client leaves, and its slot in the arena is reused by the next one.
      */
     RedisModuleDict *waitingClients;
 
     /**
-     * Dictionary[delayed/reserved strings => timers]
+     * Dictionary[delayed/reserved strings => ScheduledZset]
      */
     RedisModuleDict *timers;
+
+    /**
+     * Min-heap of the scheduled sorted sets by their due time.
+     */
+    ScheduledZset **schedule;
+    size_t scheduleSize;
+    size_t scheduleCapacity;
+
+    /**
+     * The single Redis timer of the database, armed for the earliest due time of the schedule.
+     */
+    RedisModuleTimerID timer;
+    double timerAvailableAt;
+    char timerArmed;
+
+    /**
+     * Number of jobs migrated by draining, since the module is loaded.
+     */
+    long long drainedJobs;
+
+    /**
+     * Arena of the waiting lists and scheduled sorted sets of the database.
+     */
+    SlabArena arena;
 } BlockingPopDS;
 
 /**
@@ -58,18 +155,79 @@ typedef struct BlockingPopDS
  */
 RedisModuleDict *dbs;
 
-typedef struct ClientArgumentsPair
+static size_t blockedClientSlot(BlockedClientTable *table, RedisModuleBlockedClient *bc)
+{
+    return (size_t) ((((uintptr_t) bc) >> 4) * 11400714819323198485llu) & (table->capacity - 1);
+}
+
+static void blockedClientTableSet(BlockedClientTable *table, RedisModuleBlockedClient *bc, LaravelPopArguments *arguments);
+
+static void blockedClientTableGrow(BlockedClientTable *table)
+{
+    BlockedClientTable old = *table;
+    table->capacity = old.capacity ? old.capacity * 2 : 64;
+    table->size = 0;
+    table->keys = RedisModule_Calloc(table->capacity, sizeof(RedisModuleBlockedClient *));
+    table->values = RedisModule_Alloc(table->capacity * sizeof(LaravelPopArguments *));
+    for (size_t i = 0; i < old.capacity; ++i) {
+        if (old.keys[i]) {
+            blockedClientTableSet(table, old.keys[i], old.values[i]);
+        }
+    }
+    if (old.capacity) {
+        RedisModule_Free(old.keys);
+        RedisModule_Free(old.values);
+    }
+}
+
+static void blockedClientTableSet(BlockedClientTable *table, RedisModuleBlockedClient *bc, LaravelPopArguments *arguments)
 {
-    RedisModuleBlockedClient *bc;
-    LaravelPopArguments *arguments;
-} ClientArgumentsPair;
+    // Keep the load factor at most 1/2.
+    if (2 * (table->size + 1) > table->capacity) {
+        blockedClientTableGrow(table);
+    }
+    size_t i = blockedClientSlot(table, bc);
+    while (table->keys[i] && table->keys[i] != bc) {
+        i = (i + 1) & (table->capacity - 1);
+    }
+    if (! table->keys[i]) {
+        table->keys[i] = bc;
+        table->size++;
+    }
+    table->values[i] = arguments;
+}
 
-ClientArgumentsPair *createClientArgumentsPair(RedisModuleBlockedClient *bc, LaravelPopArguments *arguments)
+/**
+ * Remove a blocked client from the table.
+ *
+ * @return its arguments, or NULL if it is not in the table.
+ */
+static LaravelPopArguments * blockedClientTableDelete(BlockedClientTable *table, RedisModuleBlockedClient *bc)
 {
-    ClientArgumentsPair *pair = RedisModule_Alloc(sizeof(ClientArgumentsPair));
-    pair->arguments = arguments;
-    pair->bc = bc;
-    return pair;
+    if (! table->size) {
+        return NULL;
+    }
+    size_t mask = table->capacity - 1;
+    size_t i = blockedClientSlot(table, bc);
+    while (table->keys[i] != bc) {
+        if (! table->keys[i]) {
+            return NULL;
+        }
+        i = (i + 1) & mask;
+    }
+    LaravelPopArguments *arguments = table->values[i];
+    table->size--;
+    // Shift the following entries back, so that no probe sequence is broken.
+    for (size_t j = (i + 1) & mask; table->keys[j]; j = (j + 1) & mask) {
+        size_t home = blockedClientSlot(table, table->keys[j]);
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            table->keys[i] = table->keys[j];
+            table->values[i] = table->values[j];
+            i = j;
+        }
+    }
+    table->keys[i] = NULL;
+    return arguments;
 }
 
 int initWaitingList()
@@ -86,7 +244,9 @@ BlockingPopDS * getBlockingPopDS(int db)
         return ds;
     }
     ds = RedisModule_Alloc(sizeof(BlockingPopDS));
-    ds->blockedClients = RedisModule_CreateDict(NULL);
+    memset(ds, 0, sizeof(BlockingPopDS));
+    ds->db = db;
+    SlabArena_Init(&ds->arena);
     ds->waitingClients = RedisModule_CreateDict(NULL);
     ds->timers = RedisModule_CreateDict(NULL);
     RedisModule_DictSetC(dbs, &db, sizeof(int), ds);
@@ -94,41 +254,76 @@ BlockingPopDS * getBlockingPopDS(int db)
     return ds;
 }
 
-void addToWaitingList(int db, RedisModuleBlockedClient *bc, LaravelPopArguments *arguments)
+static void freeWaitingList(BlockingPopDS *ds, WaitingList *waitingList)
+{
+    RedisModule_DictDel(ds->waitingClients, waitingList->strList, NULL);
+    RedisModule_FreeString(NULL, waitingList->strList);
+    RedisModule_FreeString(NULL, waitingList->strDelayed);
+    RedisModule_FreeString(NULL, waitingList->strReserved);
+    Slab_Free(&ds->arena, waitingList, sizeof(WaitingList));
+}
+
+/**
+ * Put the client at the back of the waiting list of each of its queues.
+ *
+ * @param first arguments of the first queue, which the client is mapped to.
+ */
+void addToWaitingList(int db, RedisModuleBlockedClient *bc, LaravelPopArguments *first)
 {
     BlockingPopDS *ds = getBlockingPopDS(db);
-    RedisModule_DictSetC(ds->blockedClients, bc, sizeof(RedisModuleBlockedClient *), arguments->strList);
+    for (LaravelPopArguments *arguments = first; arguments; arguments = arguments->next) {
+        WaitingList *waitingList = RedisModule_DictGet(ds->waitingClients, arguments->strList, NULL);
+        if (! waitingList) {
+            waitingList = Slab_Alloc(&ds->arena, sizeof(WaitingList));
+            waitingList->clients.size = 0;
+            waitingList->clients.front = waitingList->clients.back = NULL;
+            waitingList->strList = RedisModule_CreateStringFromString(NULL, arguments->strList);
+            waitingList->strDelayed = RedisModule_CreateStringFromString(NULL, arguments->strDelayed);
+            waitingList->strReserved = RedisModule_CreateStringFromString(NULL, arguments->strReserved);
+            RedisModule_DictSet(ds->waitingClients, arguments->strList, waitingList);
+        }
+        // The names in the command arguments don't live after the command returns, and the interned ones are
+        // retained, as the arguments may outlive the waiting list.
+        RedisModule_RetainString(NULL, waitingList->strList);
+        arguments->strList = waitingList->strList;
+        if (RedisModule_StringCompare(waitingList->strDelayed, arguments->strDelayed) == 0 &&
+                RedisModule_StringCompare(waitingList->strReserved, arguments->strReserved) == 0) {
+            RedisModule_RetainString(NULL, waitingList->strDelayed);
+            RedisModule_RetainString(NULL, waitingList->strReserved);
+            arguments->strDelayed = waitingList->strDelayed;
+            arguments->strReserved = waitingList->strReserved;
+        } else {
+            arguments->strDelayed = RedisModule_CreateStringFromString(NULL, arguments->strDelayed);
+            arguments->strReserved = RedisModule_CreateStringFromString(NULL, arguments->strReserved);
+        }
+        arguments->ownsNames = 1;
 
-    DLDictionary * waitingList = RedisModule_DictGet(ds->waitingClients, arguments->strList, NULL);
-    if (! waitingList) {
-        waitingList = DLDictionary_Create();
-        RedisModule_DictSet(ds->waitingClients, arguments->strList, waitingList);
+        arguments->waitingList = &waitingList->clients;
+        arguments->waitingNode.data = arguments;
+        DLList_Push_Back(&waitingList->clients, &arguments->waitingNode);
     }
-    DLDictionary_Set_Back(waitingList, arguments->strList, createClientArgumentsPair(bc, arguments));
+    first->bc = bc;
+    blockedClientTableSet(&ds->blockedClients, bc, first);
 }
 
-void removeFromWaitingList(int db, RedisModuleBlockedClient *bc)
+/**
+ * Remove the client from the waiting lists of all its queues.
+ *
+ * @return the arguments of the first queue, or NULL if the client is not waiting.
+ */
+LaravelPopArguments * removeFromWaitingList(int db, RedisModuleBlockedClient *bc)
 {
     BlockingPopDS *ds = getBlockingPopDS(db);
-    RedisModuleString *strList = RedisModule_DictGetC(ds->blockedClients, bc, sizeof(RedisModuleBlockedClient *), NULL);
-    if (! strList) {
-        return;
-    }
-    DLDictionary * waitingList = RedisModule_DictGet(ds->waitingClients, strList, NULL);
-    if (! waitingList) {
-        return;
-    }
-    ClientArgumentsPair *pair = DLDictionary_Delete(waitingList, strList);
-    if (! pair) {
-        return;
-    }
-    RedisModule_Free(pair);
-    // free_blocking_pop_data() in laravel-pop.c will free pair->arguments
-    if (! waitingList->list->size) {
-        DLDictionary_Drop(waitingList, NULL, NULL);
-        RedisModule_DictDel(ds->waitingClients, strList, NULL);
+    LaravelPopArguments *first = blockedClientTableDelete(&ds->blockedClients, bc);
+    for (LaravelPopArguments *arguments = first; arguments; arguments = arguments->next) {
+        DLList_Delete(arguments->waitingList, &arguments->waitingNode);
+        if (! arguments->waitingList->size) {
+            // The clients are the first member of the waiting list.
+            freeWaitingList(ds, (WaitingList *) arguments->waitingList);
+        }
+        arguments->waitingList = NULL;
     }
-    RedisModule_DictDelC(ds->blockedClients, bc, sizeof(RedisModuleBlockedClient *), NULL);
+    return first;
 }
 
 /**
@@ -140,175 +335,439 @@ void removeFromWaitingList(int db, RedisModuleBlockedClient *bc)
 void jobsWasPushed(int db, RedisModuleString *strList, long long n)
 {
     BlockingPopDS *ds = getBlockingPopDS(db);
-    DLDictionary *waitingList = RedisModule_DictGet(ds->waitingClients, strList, NULL);
+    WaitingList *waitingList = RedisModule_DictGet(ds->waitingClients, strList, NULL);
     if (waitingList == NULL) {
         return;
     }
-    DLNode *node;
-    uint64_t size = waitingList->list->size;
-    while (size > 0 && n > 0) {
-        node = waitingList->list->front;
-        DLDKeyValue *keyValue = node->data;
-        ClientArgumentsPair *pair = keyValue->value;
-        pair->arguments->jobWasAssigned = 1;
-        RedisModule_UnblockClient(pair->bc, pair->arguments);
-        n--;
-        removeFromWaitingList(db, pair->bc);
-        size--;
+    // The waiting list is freed when its last client is removed.
+    size_t waiting = waitingList->clients.size;
+    for (; waiting > 0 && n > 0; --waiting) {
+        LaravelPopArguments *arguments = waitingList->clients.front->data;
+        LaravelPopArguments *first = arguments->first;
+        removeFromWaitingList(db, first->bc);
+        first->jobWasAssigned = 1;
+        first->wokenBy = arguments;
+        RedisModule_UnblockClient(first->bc, first);
+        // The worker will retrieve up to count jobs once it is unblocked.
+        n -= first->count;
     }
 }
 
-typedef struct TimerData
+/* Return the UNIX time in microseconds */
+long long ustime(void) {
+    struct timeval tv;
+    long long ust;
+
+    gettimeofday(&tv, NULL);
+    ust = ((long long)tv.tv_sec)*1000000;
+    ust += tv.tv_usec;
+    return ust;
+}
+
+long long availableAtToMsPeriod(double availableAt)
 {
-    RedisModuleString *strList;
-    RedisModuleString *strZset;
-    char suffix[10];
-} TimerData;
+    // Round up, so that the timer doesn't fire before the jobs are available.
+    long long period = (long long) (availableAt * 1000000 - ustime() + 999) / 1000;
+    return period > 0 ? period : 0;
+}
 
-TimerData * createTimerData(RedisModuleCtx *ctx, RedisModuleString *strZset, const char *suffix)
+static void schedulePlace(BlockingPopDS *ds, ScheduledZset *sz, size_t index)
 {
-    TimerData *td = RedisModule_Alloc(sizeof(TimerData));
-    td->strZset = strZset;
-    size_t zlen;
-    const char *zstr = RedisModule_StringPtrLen(strZset, &zlen);
-    td->strList = RedisModule_CreateString(ctx, zstr, zlen - strlen(suffix));
-    strcpy(td->suffix, suffix);
-    return td;
+    ds->schedule[index] = sz;
+    sz->index = index;
 }
 
-void freeTimerData(RedisModuleCtx *ctx, TimerData *td)
+static void scheduleSiftUp(BlockingPopDS *ds, size_t index)
 {
-    if (td) {
-        if (td->strList) {
-            RedisModule_FreeString(ctx, td->strList);
-            td->strList = NULL;
+    ScheduledZset *sz = ds->schedule[index];
+    while (index) {
+        size_t parent = (index - 1) / 2;
+        if (ds->schedule[parent]->availableAt <= sz->availableAt) {
+            break;
         }
-        RedisModule_Free(td);
+        schedulePlace(ds, ds->schedule[parent], index);
+        index = parent;
     }
+    schedulePlace(ds, sz, index);
 }
 
-/* Return the UNIX time in microseconds */
-long long ustime(void) {
-    struct timeval tv;
-    long long ust;
+static void scheduleSiftDown(BlockingPopDS *ds, size_t index)
+{
+    ScheduledZset *sz = ds->schedule[index];
+    for (;;) {
+        size_t child = 2 * index + 1;
+        if (child >= ds->scheduleSize) {
+            break;
+        }
+        if (child + 1 < ds->scheduleSize && ds->schedule[child + 1]->availableAt < ds->schedule[child]->availableAt) {
+            child++;
+        }
+        if (sz->availableAt <= ds->schedule[child]->availableAt) {
+            break;
+        }
+        schedulePlace(ds, ds->schedule[child], index);
+        index = child;
+    }
+    schedulePlace(ds, sz, index);
+}
 
-    gettimeofday(&tv, NULL);
-    ust = ((long long)tv.tv_sec)*1000000;
-    ust += tv.tv_usec;
-    return ust;
+static void scheduleInsert(BlockingPopDS *ds, ScheduledZset *sz)
+{
+    if (ds->scheduleSize == ds->scheduleCapacity) {
+        ds->scheduleCapacity = ds->scheduleCapacity ? ds->scheduleCapacity * 2 : 16;
+        ds->schedule = RedisModule_Realloc(ds->schedule, sizeof(ScheduledZset *) * ds->scheduleCapacity);
+    }
+    schedulePlace(ds, sz, ds->scheduleSize++);
+    scheduleSiftUp(ds, sz->index);
 }
 
-long long availableAtToMsPeriod(double availableAt)
+static void scheduleRemove(BlockingPopDS *ds, ScheduledZset *sz)
 {
-    return (availableAt * 1000000 - ustime()) / 1000;
+    size_t index = sz->index;
+    sz->index = NOT_SCHEDULED;
+    ds->scheduleSize--;
+    if (index != ds->scheduleSize) {
+        ScheduledZset *last = ds->schedule[ds->scheduleSize];
+        schedulePlace(ds, last, index);
+        scheduleSiftUp(ds, index);
+        scheduleSiftDown(ds, last->index);
+    }
 }
 
-void timerCallback(RedisModuleCtx *ctx, void *data)
+static ScheduledZset * createScheduledZset(BlockingPopDS *ds, RedisModuleString *strZset, const char *suffix)
 {
-    int db = RedisModule_GetSelectedDb(ctx);
-    BlockingPopDS *ds = getBlockingPopDS(db);
-    TimerData *td = data;
-    RedisModuleTimerID *timerId;
-    RedisModule_DictDel(ds->timers, td->strZset, &timerId);
-    RedisModule_Free(timerId);
-    RedisModuleKey *list = RedisModule_OpenKey(ctx, td->strList, REDISMODULE_WRITE);
-    RedisModuleKey *zset = RedisModule_OpenKey(ctx, td->strZset, REDISMODULE_WRITE);
-    // validate key types
-    int ltype = RedisModule_KeyType(list);
-    int ztype = RedisModule_KeyType(zset);
-    if ((ltype == REDISMODULE_KEYTYPE_EMPTY || ltype == REDISMODULE_KEYTYPE_LIST) &&
-            (ztype == REDISMODULE_KEYTYPE_EMPTY || ztype == REDISMODULE_KEYTYPE_ZSET)) {
-        long long n = migrateExpiredJobs(ctx, list, td->strList, (double)ustime()/1000000, zset, td->strZset, td->suffix);
-        jobsWasPushed(db, td->strList, n);
-        updateTimerFor(ctx, td->strZset, td->suffix);
+    ScheduledZset *sz = Slab_Alloc(&ds->arena, sizeof(ScheduledZset));
+    size_t zlen;
+    const char *zstr = RedisModule_StringPtrLen(strZset, &zlen);
+    sz->strZset = RedisModule_CreateString(NULL, zstr, zlen);
+    sz->strList = RedisModule_CreateString(NULL, zstr, zlen - strlen(suffix));
+    strcpy(sz->suffix, suffix);
+    sz->index = NOT_SCHEDULED;
+    sz->firing = 0;
+    sz->draining = 0;
+    memset(&sz->stats, 0, sizeof(QueueStatsCache));
+    return sz;
+}
+
+static void freeScheduledZset(BlockingPopDS *ds, ScheduledZset *sz)
+{
+    RedisModule_DictDel(ds->timers, sz->strZset, NULL);
+    RedisModule_FreeString(NULL, sz->strZset);
+    RedisModule_FreeString(NULL, sz->strList);
+    Slab_Free(&ds->arena, sz, sizeof(ScheduledZset));
+}
+
+void schedulerCallback(RedisModuleCtx *ctx, void *data);
+
+/**
+ * Make sure the timer of the database is armed for the earliest due time, re-arming it only if that time has changed.
+ */
+static void armScheduler(RedisModuleCtx *ctx, BlockingPopDS *ds)
+{
+    if (ds->timerArmed && ds->scheduleSize && ds->timerAvailableAt == ds->schedule[0]->availableAt) {
+        return;
+    }
+    if (ds->timerArmed) {
+        RedisModule_StopTimer(ctx, ds->timer, NULL);
+        ds->timerArmed = 0;
+    }
+    if (ds->scheduleSize) {
+        ds->timerAvailableAt = ds->schedule[0]->availableAt;
+        ds->timer = RedisModule_CreateTimer(ctx, availableAtToMsPeriod(ds->timerAvailableAt), schedulerCallback, ds);
+        ds->timerArmed = 1;
+    }
+}
+
+/**
+ * Put a sorted set in the schedule, or move it to its new place.
+ */
+static void scheduleAt(BlockingPopDS *ds, ScheduledZset *sz, double availableAt)
+{
+    sz->availableAt = availableAt;
+    if (sz->index == NOT_SCHEDULED) {
+        scheduleInsert(ds, sz);
+    } else {
+        scheduleSiftUp(ds, sz->index);
+        scheduleSiftDown(ds, sz->index);
     }
+}
+
+/**
+ * Migrate the available jobs of a scheduled sorted set and deliver them to the blocked clients.
+ * A draining sorted set is migrated in batches until the backlog clears or the deadline is reached.
+ */
+static void fireScheduledZset(RedisModuleCtx *ctx, BlockingPopDS *ds, ScheduledZset *sz, long long deadline)
+{
+    RedisModuleKey *list = RedisModule_OpenKey(ctx, sz->strList, REDISMODULE_WRITE);
+    LaravelQueue *native = getNativeQueue(ctx, list, sz->strList, 0);
+    RedisModuleKey *zset = NULL;
+    if (! native) {
+        zset = RedisModule_OpenKey(ctx, sz->strZset, REDISMODULE_WRITE);
+        // validate key types
+        int ltype = RedisModule_KeyType(list);
+        int ztype = RedisModule_KeyType(zset);
+        if ((ltype != REDISMODULE_KEYTYPE_EMPTY && ltype != REDISMODULE_KEYTYPE_LIST) ||
+                (ztype != REDISMODULE_KEYTYPE_EMPTY && ztype != REDISMODULE_KEYTYPE_ZSET)) {
+            sz->draining = 0;
+            RedisModule_CloseKey(list);
+            RedisModule_CloseKey(zset);
+            return;
+        }
+    }
+    // Draining sorted sets are scheduled to run immediately, not at a due time.
+    long long late = sz->availableAt > 0 ? ustime() - (long long) (sz->availableAt * 1000000) : -1;
+    long long n, total = 0;
+    do {
+        double currentTime = (double)ustime()/1000000;
+        if (native) {
+            n = migrateExpiredNativeJobs(ctx, native, sz->strList, currentTime, sz->strZset, sz->suffix);
+        } else {
+            n = migrateExpiredJobs(ctx, list, sz->strList, currentTime, zset, sz->strZset, sz->suffix, &sz->stats);
+        }
+        total += n;
+    } while (n == LARAVEL_MAX_KEY_TO_MIGRATE && ustime() < deadline);
+    if (late >= 0 && total) {
+        Latency_Timer(getCachedQueueStats(ctx, native ? &native->stats : &sz->stats, sz->strList, ""), late);
+    }
+    if (sz->draining) {
+        if (n == LARAVEL_MAX_KEY_TO_MIGRATE) {
+            // Continue in the next event loop iteration.
+            scheduleAt(ds, sz, 0);
+        } else {
+            sz->drained += n;
+            ds->drainedJobs += n;
+            sz->draining = 0;
+        }
+    }
+    jobsWasPushed(ds->db, sz->strList, total);
     RedisModule_CloseKey(list);
-    RedisModule_CloseKey(zset);
-    freeTimerData(ctx, td);
+    if (zset) {
+        RedisModule_CloseKey(zset);
+    }
 }
 
-void jobWillBeAvailable(RedisModuleCtx *ctx, RedisModuleString *strZSet, double availableAt, const char *suffix)
+/**
+ * Fire all the sorted sets that are due, then re-arm the timer for the next one.
+ */
+void schedulerCallback(RedisModuleCtx *ctx, void *data)
+{
+    BlockingPopDS *ds = data;
+    ds->timerArmed = 0;
+    long long deadline = ustime() + LARAVEL_DRAIN_BUDGET;
+    double currentTime = (double)ustime()/1000000;
+    // Take the due sorted sets out first, so that the ones rescheduled while firing wait for the next round.
+    size_t n = 0;
+    ScheduledZset **due = RedisModule_PoolAlloc(ctx, sizeof(ScheduledZset *) * (ds->scheduleSize + 1));
+    while (ds->scheduleSize && ds->schedule[0]->availableAt <= currentTime) {
+        due[n] = ds->schedule[0];
+        due[n]->firing = 1;
+        scheduleRemove(ds, due[n++]);
+    }
+    for (size_t i = 0; i < n; ++i) {
+        fireScheduledZset(ctx, ds, due[i], deadline);
+        due[i]->firing = 0;
+        if (due[i]->index == NOT_SCHEDULED) {
+            freeScheduledZset(ds, due[i]);
+        }
+    }
+    armScheduler(ctx, ds);
+}
+
+/**
+ * Check if any client is waiting for the queue of a delayed/reserved sorted set.
+ */
+static int isWaitedFor(BlockingPopDS *ds, RedisModuleString *strZSet, const char *suffix)
 {
-    int db = RedisModule_GetSelectedDb(ctx);
-    BlockingPopDS *ds = getBlockingPopDS(db);
     size_t slen = strlen(suffix);
     size_t len;
     const char * zset = RedisModule_StringPtrLen(strZSet, &len);
     if (len < slen || memcmp(suffix, zset + len - slen, slen)) {
         // suffix does not match!
-        return;
+        return 0;
     }
-    if (RedisModule_DictGetC(ds->waitingClients, zset, len - slen, NULL) == NULL) {
-        // No client is waiting!
+    WaitingList *waitingList = RedisModule_DictGetC(ds->waitingClients, (void *) zset, len - slen, NULL);
+    return waitingList && waitingList->clients.size;
+}
+
+void jobWillBeAvailable(RedisModuleCtx *ctx, RedisModuleString *strZSet, double availableAt, const char *suffix)
+{
+    int db = RedisModule_GetSelectedDb(ctx);
+    BlockingPopDS *ds = getBlockingPopDS(db);
+    if (! isWaitedFor(ds, strZSet, suffix)) {
         return;
     }
-    // Stop the previous timer
-    RedisModuleTimerID *timer = RedisModule_DictGet(ds->timers, strZSet, NULL);
-    if (timer) {
-
-        void *data;
-        RedisModule_StopTimer(ctx, *timer, &data);
-        RedisModule_Free(data);
-    } else {
-        timer = RedisModule_Alloc(sizeof(RedisModuleTimerID));
-        RedisModule_DictSet(ds->timers, strZSet, timer);
+    ScheduledZset *sz = RedisModule_DictGet(ds->timers, strZSet, NULL);
+    if (! sz) {
+        sz = createScheduledZset(ds, strZSet, suffix);
+        RedisModule_DictSet(ds->timers, strZSet, sz);
     }
-    // Start a new timer
-    TimerData *td = createTimerData(ctx, strZSet, suffix);
-    *timer = RedisModule_CreateTimer(ctx, availableAtToMsPeriod(availableAt), timerCallback, td);
+    scheduleAt(ds, sz, availableAt);
+    armScheduler(ctx, ds);
 }
 
 void jobWontBeAvailable(RedisModuleCtx *ctx, RedisModuleString *strZSet)
 {
     int db = RedisModule_GetSelectedDb(ctx);
     BlockingPopDS *ds = getBlockingPopDS(db);
-    RedisModuleTimerID *timer = RedisModule_DictGet(ds->timers, strZSet, NULL);
-    if (timer) {
-        void *data;
-        RedisModule_StopTimer(ctx, *timer, &data);
-        RedisModule_Free(timer);
-        freeTimerData(ctx, data);
-        RedisModule_DictDel(ds->timers, strZSet, NULL);
+    ScheduledZset *sz = RedisModule_DictGet(ds->timers, strZSet, NULL);
+    if (! sz) {
+        return;
+    }
+    if (sz->index != NOT_SCHEDULED) {
+        scheduleRemove(ds, sz);
+    }
+    // The scheduler frees the sorted sets it is firing.
+    if (! sz->firing) {
+        freeScheduledZset(ds, sz);
+    }
+    armScheduler(ctx, ds);
+}
+
+/**
+ * Get the minimum score of an open sorted set key.
+ */
+static int zsetMinScore(RedisModuleCtx *ctx, RedisModuleKey *zset, double *score)
+{
+    if (RedisModule_KeyType(zset) != REDISMODULE_KEYTYPE_ZSET ||
+            RedisModule_ZsetFirstInScoreRange(zset, REDISMODULE_NEGATIVE_INFINITE, REDISMODULE_POSITIVE_INFINITE, 0, 0) != REDISMODULE_OK) {
+        return 0;
+    }
+    int found = 0;
+    if (! RedisModule_ZsetRangeEndReached(zset)) {
+        RedisModuleString *min = RedisModule_ZsetRangeCurrentElement(zset, score);
+        RedisModule_FreeString(ctx, min);
+        found = 1;
     }
+    RedisModule_ZsetRangeStop(zset);
+    return found;
 }
 
-int minScore(RedisModuleCtx *ctx, RedisModuleString *key, double *score)
+/**
+ * Get the minimum score of a delayed/reserved queue.
+ *
+ * @param zset the open key of the sorted set, or NULL to open it here.
+ */
+int minScore(RedisModuleCtx *ctx, RedisModuleKey *zset, RedisModuleString *strZset, const char *suffix, double *score)
 {
-    RedisModuleCallReply *reply = RedisModule_Call(ctx, "ZRANGE", "sllc", key, 0ll, 0ll, "WITHSCORES");
-    if ( RedisModule_CallReplyType(reply) != REDISMODULE_REPLY_ARRAY || RedisModule_CallReplyLength(reply) != 2) {
-        RedisModule_FreeCallReply(reply);
+    if (zset && RedisModule_KeyType(zset) == REDISMODULE_KEYTYPE_ZSET) {
+        return zsetMinScore(ctx, zset, score);
+    }
+    RedisModuleKey *queueKey;
+    RedisModuleString *strQueue;
+    LaravelQueue *queue = openNativeQueueOf(ctx, strZset, suffix, 0, &queueKey, &strQueue);
+    if (queue) {
+        JobHeapEntry *min = JobHeap_Min(LaravelQueue_Heap(queue, suffix));
+        if (min) {
+            *score = min->score;
+        }
+        RedisModule_CloseKey(queueKey);
+        RedisModule_FreeString(ctx, strQueue);
+        return min != NULL;
+    }
+    if (zset) {
+        // The given key is empty.
         return 0;
     }
-    RedisModuleCallReply *rscore = RedisModule_CallReplyArrayElement(reply, 1);
-    RedisModuleString *sscore = RedisModule_CreateStringFromCallReply(rscore);
-    RedisModule_StringToDouble(sscore, score);
-    RedisModule_FreeString(ctx, sscore);
-    RedisModule_FreeCallReply(rscore);
-    RedisModule_FreeCallReply(reply);
-    return 1;
+    zset = RedisModule_OpenKey(ctx, strZset, REDISMODULE_READ);
+    int found = zsetMinScore(ctx, zset, score);
+    RedisModule_CloseKey(zset);
+    return found;
 }
 
-void updateTimerFor(RedisModuleCtx *ctx, RedisModuleString *strZset, const char *suffix)
+void updateTimerFor(RedisModuleCtx *ctx, RedisModuleKey *zset, RedisModuleString *strZset, const char *suffix)
 {
     double score;
-    if (minScore(ctx, strZset, &score)) {
+    if (minScore(ctx, zset, strZset, suffix, &score)) {
         jobWillBeAvailable(ctx, strZset, score, suffix);
     } else {
         jobWontBeAvailable(ctx, strZset);
     }
 }
 
-void createTimerFor(RedisModuleCtx *ctx, RedisModuleString *strZset, const char *suffix)
+void scheduleIfEarlier(RedisModuleCtx *ctx, RedisModuleKey *zset, RedisModuleString *strZset, double availableAt,
+                       const char *suffix)
+{
+    int db = RedisModule_GetSelectedDb(ctx);
+    BlockingPopDS *ds = getBlockingPopDS(db);
+    ScheduledZset *sz = RedisModule_DictGet(ds->timers, strZset, NULL);
+    if (sz == NULL || sz->index == NOT_SCHEDULED) {
+        // The earliest due time is unknown.
+        if (isWaitedFor(ds, strZset, suffix)) {
+            updateTimerFor(ctx, zset, strZset, suffix);
+        }
+    } else if (availableAt < sz->availableAt) {
+        jobWillBeAvailable(ctx, strZset, availableAt, suffix);
+    }
+}
+
+void createTimerFor(RedisModuleCtx *ctx, RedisModuleKey *zset, RedisModuleString *strZset, const char *suffix)
 {
     int db = RedisModule_GetSelectedDb(ctx);
     BlockingPopDS *ds = getBlockingPopDS(db);
     double score;
-    if (RedisModule_DictGet(ds->timers, strZset, NULL) == NULL && minScore(ctx, strZset, &score)) {
+    ScheduledZset *sz = RedisModule_DictGet(ds->timers, strZset, NULL);
+    if ((sz == NULL || sz->index == NOT_SCHEDULED) && minScore(ctx, zset, strZset, suffix, &score)) {
         jobWillBeAvailable(ctx, strZset, score, suffix);
     }
 }
 
-#define LARAVEL_MAX_KEY_TO_MIGRATE 100
+
+/**
+ * Keep migrating the backlog of a sorted set in the next timer callbacks, even if no client is waiting.
+ *
+ * @param n number of jobs that are just migrated.
+ */
+static void drainLater(RedisModuleCtx *ctx, RedisModuleString *strZset, const char *suffix, long long n)
+{
+    int db = RedisModule_GetSelectedDb(ctx);
+    BlockingPopDS *ds = getBlockingPopDS(db);
+    ScheduledZset *sz = RedisModule_DictGet(ds->timers, strZset, NULL);
+    if (! sz) {
+        sz = createScheduledZset(ds, strZset, suffix);
+        RedisModule_DictSet(ds->timers, strZset, sz);
+    }
+    if (! sz->draining) {
+        sz->draining = 1;
+        sz->drained = 0;
+        sz->drainStartedAt = ustime() / 1000;
+    }
+    sz->drained += n;
+    ds->drainedJobs += n;
+    // The scheduler re-schedules the sorted sets it is firing.
+    if (! sz->firing) {
+        scheduleAt(ds, sz, 0);
+        armScheduler(ctx, ds);
+    }
+}
+
+/**
+ * @param length the length of the list after migration.
+ * @param readyAt the scores of the migrated jobs in microseconds.
+ */
+static void countMigratedJobs(QueueStats *stats, const char *suffix, long long n, long long length,
+                              const long long *readyAt)
+{
+    if (strcmp(suffix, ":delayed") == 0) {
+        stats->migratedDelayed += n;
+    } else {
+        stats->migratedReserved += n;
+    }
+    Latency_Pushed(stats, length, n, readyAt);
+}
+
+/**
+ * Update the timer of a sorted set after migrating its expired jobs.
+ */
+static void jobsWasMigrated(RedisModuleCtx *ctx, RedisModuleKey *zset, RedisModuleString *strZset, const char *suffix,
+                            long long n)
+{
+    if (n == LARAVEL_MAX_KEY_TO_MIGRATE) {
+        // There may be more expired jobs.
+        drainLater(ctx, strZset, suffix, n);
+    } else {
+        updateTimerFor(ctx, zset, strZset, suffix);
+    }
+}
 
 /**
  * Migrate Expired Jobs
@@ -316,33 +775,149 @@ void createTimerFor(RedisModuleCtx *ctx, RedisModuleString *strZset, const char
  * @return number of migrated jobs.
  */
 long long migrateExpiredJobs(RedisModuleCtx *ctx, RedisModuleKey *list, RedisModuleString *strList, double currentTime,
-                             RedisModuleKey *zset, RedisModuleString *strZset, const char *suffix)
+                             RedisModuleKey *zset, RedisModuleString *strZset, const char *suffix, QueueStatsCache *stats)
 {
     // If the key is empty, iteration fails
     if (RedisModule_ZsetFirstInScoreRange(zset,  REDISMODULE_NEGATIVE_INFINITE, currentTime, 0, 0) == REDISMODULE_ERR) {
         return 0;
     }
 
+    // Collect a constant number of jobs to maintain a logarithmic time complexity.
+    RedisModuleString **jobs = RedisModule_PoolAlloc(ctx, sizeof(RedisModuleString *) * LARAVEL_MAX_KEY_TO_MIGRATE);
+    long long *readyAt = RedisModule_PoolAlloc(ctx, sizeof(long long) * LARAVEL_MAX_KEY_TO_MIGRATE);
     double score;
     long long n;
-    // Migrate a constant number of jobs to maintain a logarithmic time complexity.
     for (n = 0; n < LARAVEL_MAX_KEY_TO_MIGRATE && !RedisModule_ZsetRangeEndReached(zset); ++n, RedisModule_ZsetRangeNext(zset)) {
-        // Get the job
-        RedisModuleString *cur = RedisModule_ZsetRangeCurrentElement(zset, &score);
-
-        // Migrate it to the list
-        RedisModule_ListPush(list, REDISMODULE_LIST_TAIL, cur);
-        RedisModule_Replicate(ctx, "rpush", "ss", strList, cur);
-        RedisModule_FreeString(ctx, cur);
+        jobs[n] = RedisModule_ZsetRangeCurrentElement(zset, &score);
+        readyAt[n] = (long long) (score * 1000000);
     }
+    RedisModule_ZsetRangeStop(zset);
 
-    // Remove migrated jobs from zset
+    // Migrate them to the list, replicating the whole batch as one rpush and one zremrangebyrank.
+    for (long long i = 0; i < n; ++i) {
+        RedisModule_ListPush(list, REDISMODULE_LIST_TAIL, jobs[i]);
+        RedisModule_ZsetRem(zset, jobs[i], NULL);
+    }
     if (n) {
-        RedisModuleCallReply *reply = RedisModule_Call(ctx, "zremrangebyrank", "sll", strZset, 0ll, n - 1);
-        RedisModule_FreeCallReply(reply);
+        RedisModule_Replicate(ctx, "rpush", "sv", strList, jobs, (size_t) n);
         RedisModule_Replicate(ctx, "zremrangebyrank", "sll", strZset, 0ll, n - 1);
     }
-    RedisModule_ZsetRangeStop(zset);
-    updateTimerFor(ctx, strZset, suffix);
+    for (long long i = 0; i < n; ++i) {
+        RedisModule_FreeString(ctx, jobs[i]);
+    }
+    if (n) {
+        countMigratedJobs(getCachedQueueStats(ctx, stats, strList, ""), suffix, n,
+                          (long long) RedisModule_ValueLength(list), readyAt);
+    }
+    jobsWasMigrated(ctx, zset, strZset, suffix, n);
+    return n;
+}
+
+
+/**
+ * Migrate Expired Jobs of a native queue
+ *
+ * @return number of migrated jobs.
+ */
+long long migrateExpiredNativeJobs(RedisModuleCtx *ctx, LaravelQueue *queue, RedisModuleString *strList, double currentTime,
+                                   RedisModuleString *strZset, const char *suffix)
+{
+    JobHeap *heap = LaravelQueue_Heap(queue, suffix);
+    JobHeapEntry *min;
+    long long readyAt[LARAVEL_MAX_KEY_TO_MIGRATE];
+    long long n;
+    // Migrate a constant number of jobs to maintain a logarithmic time complexity.
+    for (n = 0; n < LARAVEL_MAX_KEY_TO_MIGRATE && (min = JobHeap_Min(heap)) && min->score <= currentTime; ++n) {
+        readyAt[n] = (long long) (min->score * 1000000);
+        JobDeque_Push_Back(&queue->ready, JobHeap_Pop_Min(heap));
+    }
+    if (n) {
+        RedisModule_Replicate(ctx, "laravel.native", "sccl", strList, "MIGRATE",
+                              heap == &queue->delayed ? "DELAYED" : "RESERVED", n);
+        countMigratedJobs(getCachedQueueStats(ctx, &queue->stats, strList, ""), suffix, n,
+                          (long long) queue->ready.size, readyAt);
+    }
+    jobsWasMigrated(ctx, NULL, strZset, suffix, n);
     return n;
 }
+
+/**
+ * laravel.draining
+ *
+ * Reply with the draining progress of the current database:
+ * the total number of drained jobs, followed by [sorted set, drained jobs, elapsed milliseconds] of each draining sorted set.
+ */
+int Laravel_Draining_Command(RedisModuleCtx *ctx, RedisModuleString **argv, int argc)
+{
+    REDISMODULE_NOT_USED(argv);
+    if (argc != 1) {
+        return RedisModule_WrongArity(ctx);
+    }
+    BlockingPopDS *ds = getBlockingPopDS(RedisModule_GetSelectedDb(ctx));
+    long long now = ustime() / 1000;
+    long long len = 1;
+    RedisModule_ReplyWithArray(ctx, REDISMODULE_POSTPONED_ARRAY_LEN);
+    RedisModule_ReplyWithLongLong(ctx, ds->drainedJobs);
+    RedisModuleDictIter *iter = RedisModule_DictIteratorStartC(ds->timers, "^", NULL, 0);
+    ScheduledZset *sz;
+    while (RedisModule_DictNextC(iter, NULL, (void **) &sz)) {
+        if (! sz->draining) {
+            continue;
+        }
+        RedisModule_ReplyWithArray(ctx, 3);
+        RedisModule_ReplyWithString(ctx, sz->strZset);
+        RedisModule_ReplyWithLongLong(ctx, sz->drained);
+        RedisModule_ReplyWithLongLong(ctx, now - sz->drainStartedAt);
+        len++;
+    }
+    RedisModule_DictIteratorStop(iter);
+    RedisModule_ReplySetArrayLength(ctx, len);
+    return REDISMODULE_OK;
+}
+
+int Create_Laravel_Draining_Command(RedisModuleCtx *ctx)
+{
+    if (RedisModule_CreateCommand(ctx, "laravel.draining", Laravel_Draining_Command, "readonly fast", 0, 0, 0)
+        == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
+
+    return REDISMODULE_OK;
+}
+
+/**
+ * laravel.memory
+ *
+ * Reply with the occupancy of the module's slab arenas: [allocated bytes, used bytes, objects], followed by the bytes
+ * of the ready times tracked for the latency of the queues.
+ */
+int Laravel_Memory_Command(RedisModuleCtx *ctx, RedisModuleString **argv, int argc)
+{
+    REDISMODULE_NOT_USED(argv);
+    if (argc != 1) {
+        return RedisModule_WrongArity(ctx);
+    }
+    SlabStats stats = {0, 0, 0};
+    RedisModuleDictIter *iter = RedisModule_DictIteratorStartC(dbs, "^", NULL, 0);
+    BlockingPopDS *ds;
+    while (RedisModule_DictNextC(iter, NULL, (void **) &ds)) {
+        SlabArena_Stats(&ds->arena, &stats);
+    }
+    RedisModule_DictIteratorStop(iter);
+    RedisModule_ReplyWithArray(ctx, 4);
+    RedisModule_ReplyWithLongLong(ctx, (long long) stats.allocated);
+    RedisModule_ReplyWithLongLong(ctx, (long long) stats.used);
+    RedisModule_ReplyWithLongLong(ctx, (long long) stats.objects);
+    RedisModule_ReplyWithLongLong(ctx, (long long) Latency_ReadyTimesMemory());
+    return REDISMODULE_OK;
+}
+
+int Create_Laravel_Memory_Command(RedisModuleCtx *ctx)
+{
+    if (RedisModule_CreateCommand(ctx, "laravel.memory", Laravel_Memory_Command, "readonly fast", 0, 0, 0)
+        == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
+
+    return REDISMODULE_OK;
+}
@@ -32,10 +32,26 @@
 #define LARAVEL_QUEUE_BLOCKING_POP_H
 
 #include "redismodule.h"
+#include "queue-type.h"
+#include "containers.h"
+#include "stats.h"
 
 typedef struct LaravelPopArguments
 {
+    /**
+     * A pop may be given several queues in priority order. Each queue has its own arguments, linked by next.
+     * The options, the state and the blocked client are kept in the arguments of the first queue.
+     */
+    struct LaravelPopArguments *first;
+    struct LaravelPopArguments *next;
+
+    /**
+     * The queue whose jobs were assigned to the blocked client.
+     */
+    struct LaravelPopArguments *wokenBy;
+
     RedisModuleKey *list;
+    LaravelQueue *native;
     RedisModuleKey *delayed;
     RedisModuleKey *reserved;
     RedisModuleString *strList;
@@ -43,8 +59,26 @@ typedef struct LaravelPopArguments
     RedisModuleString *strReserved;
     long long retryAfterMs;
     long long blockFor;
+    long long count;
+    long long blockedAt;
+
+    /**
+     * The counters of the queue, looked up once while the arguments live.
+     */
+    QueueStatsCache stats;
+    char many;
     char jobWasAssigned;
     char jobWasDelivered;
+
+    /**
+     * Bookkeeping of a blocked client, embedded to block without allocation.
+     * Once blocked, the arguments own a reference to their names: strList is interned by the waiting list, and so are
+     * strDelayed and strReserved unless they differ from the ones of the waiting list.
+     */
+    RedisModuleBlockedClient *bc;
+    DLNode waitingNode;
+    DLList *waitingList;
+    char ownsNames;
 } LaravelPopArguments;
 
 /* Return the UNIX time in microseconds */
@@ -54,18 +88,48 @@ long long ustime(void);
 #define msdelayToTime(delay) (double)msdelayToMstime(delay)/1000
 
 int initWaitingList();
-void addToWaitingList(int db, RedisModuleBlockedClient *bc, LaravelPopArguments *arguments);
-void removeFromWaitingList(int db, RedisModuleBlockedClient *bc);
+/**
+ * Put a blocked client at the back of the waiting list of each of its queues.
+ */
+void addToWaitingList(int db, RedisModuleBlockedClient *bc, LaravelPopArguments *first);
+/**
+ * Remove a blocked client from the waiting lists of all its queues.
+ *
+ * @return the arguments of its first queue, or NULL if it is not waiting anymore.
+ */
+LaravelPopArguments * removeFromWaitingList(int db, RedisModuleBlockedClient *bc);
 void jobsWasPushed(int db, RedisModuleString *strList, long long n);
-void updateTimerFor(RedisModuleCtx *ctx, RedisModuleString *strZset, const char *suffix);
-void createTimerFor(RedisModuleCtx *ctx, RedisModuleString *strZset, const char *suffix);
+/**
+ * The zset parameter of the timer functions is the open key of the sorted set if the caller has one, or NULL.
+ * The key must not be stale, i.e. the sorted set must not be changed by RedisModule_Call() since it was opened.
+ */
+void updateTimerFor(RedisModuleCtx *ctx, RedisModuleKey *zset, RedisModuleString *strZset, const char *suffix);
+/**
+ * Update the timer of a sorted set after adding a job that will be available at the given time.
+ * Unlike updateTimerFor(), it doesn't query the sorted set if its timer is already armed earlier.
+ */
+void scheduleIfEarlier(RedisModuleCtx *ctx, RedisModuleKey *zset, RedisModuleString *strZset, double availableAt,
+                       const char *suffix);
+void createTimerFor(RedisModuleCtx *ctx, RedisModuleKey *zset, RedisModuleString *strZset, const char *suffix);
 
 /**
  * Migrate Expired Jobs
  *
+ * @param stats the cache of the counters of the queue, see getCachedQueueStats().
  * @return number of migrated jobs.
  */
 long long migrateExpiredJobs(RedisModuleCtx *ctx, RedisModuleKey *list, RedisModuleString *strList, double currentTime,
-                             RedisModuleKey *zset, RedisModuleString *strZset, const char *suffix);
+                             RedisModuleKey *zset, RedisModuleString *strZset, const char *suffix, QueueStatsCache *stats);
+
+/**
+ * Migrate Expired Jobs of a native queue
+ *
+ * @return number of migrated jobs.
+ */
+long long migrateExpiredNativeJobs(RedisModuleCtx *ctx, LaravelQueue *queue, RedisModuleString *strList, double currentTime,
+                                   RedisModuleString *strZset, const char *suffix);
+
+int Create_Laravel_Draining_Command(RedisModuleCtx *ctx);
+int Create_Laravel_Memory_Command(RedisModuleCtx *ctx);
 
 #endif //LARAVEL_QUEUE_BLOCKING_POP_H
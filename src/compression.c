@@ -0,0 +1,379 @@
+/*
+ * Copyright (c) 2018, Hamid Alaei Varnosfaderani
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "compression.h"
+
+#include <stdint.h>
+#include <string.h>
+#include "config.h"
+#include "envelope.h"
+#include "queue-type.h"
+
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+#define LZ_HASH_BITS 12
+/**
+ * Matches are not looked for in the last bytes, so that the 4-byte reads of the match finder stay inside the job.
+ */
+#define LZ_LAST_LITERALS 12
+/**
+ * Most bytes a byte of a block can decompress to: a length byte of 255 extends a match by 255 bytes.
+ */
+#define LZ_MAX_EXPANSION 255
+
+/**
+ * Whether a compressed job may be stored, so the jobs given by workers are only looked up compressed when they may be.
+ */
+static int compressedJobsStored = 0;
+
+static uint32_t read32(const unsigned char *p)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static uint32_t lzHash(uint32_t sequence)
+{
+    return (sequence * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+static unsigned char * lzWriteLength(unsigned char *op, size_t length)
+{
+    for (; length >= 255; length -= 255) {
+        *op++ = 255;
+    }
+    *op++ = (unsigned char) length;
+    return op;
+}
+
+static unsigned char * lzWriteSequence(unsigned char *op, const unsigned char *literals, size_t literalLength,
+                                       size_t matchLength, size_t offset)
+{
+    unsigned char *token = op++;
+    *token = (unsigned char) ((literalLength < 15 ? literalLength : 15) << 4);
+    if (literalLength >= 15) {
+        op = lzWriteLength(op, literalLength - 15);
+    }
+    memcpy(op, literals, literalLength);
+    op += literalLength;
+    if (matchLength) {
+        *op++ = (unsigned char) offset;
+        *op++ = (unsigned char) (offset >> 8);
+        matchLength -= LZ_MIN_MATCH;
+        *token |= (unsigned char) (matchLength < 15 ? matchLength : 15);
+        if (matchLength >= 15) {
+            op = lzWriteLength(op, matchLength - 15);
+        }
+    }
+    return op;
+}
+
+/**
+ * Greedy LZ77 with a single-entry hash table of 4-byte sequences.
+ */
+static size_t lzCompress(const unsigned char *src, size_t len, unsigned char *dst)
+{
+    uint32_t table[1 << LZ_HASH_BITS];
+    memset(table, 0, sizeof(table));
+    unsigned char *op = dst;
+    const unsigned char *anchor = src;
+    if (len > LZ_LAST_LITERALS + LZ_MIN_MATCH) {
+        const unsigned char *ip = src + 1;
+        const unsigned char *limit = src + len - LZ_LAST_LITERALS;
+        while (ip < limit) {
+            uint32_t sequence = read32(ip);
+            uint32_t h = lzHash(sequence);
+            const unsigned char *ref = src + table[h];
+            table[h] = (uint32_t) (ip - src);
+            if (ref >= ip || ip - ref > LZ_MAX_OFFSET || read32(ref) != sequence) {
+                ip++;
+                continue;
+            }
+            const unsigned char *matchEnd = ip + LZ_MIN_MATCH;
+            const unsigned char *refEnd = ref + LZ_MIN_MATCH;
+            while (matchEnd < limit && *matchEnd == *refEnd) {
+                matchEnd++;
+                refEnd++;
+            }
+            while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+                ip--;
+                ref--;
+            }
+            op = lzWriteSequence(op, anchor, (size_t) (ip - anchor), (size_t) (matchEnd - ip), (size_t) (ip - ref));
+            ip = anchor = matchEnd;
+        }
+    }
+    op = lzWriteSequence(op, anchor, (size_t) (src + len - anchor), 0, 0);
+    return (size_t) (op - dst);
+}
+
+static int lzReadLength(const unsigned char **ip, const unsigned char *end, size_t *length)
+{
+    unsigned char b;
+    do {
+        if (*ip == end) {
+            return 0;
+        }
+        b = *(*ip)++;
+        *length += b;
+    } while (b == 255);
+    return 1;
+}
+
+/**
+ * @return 1 if exactly len bytes were decompressed, 0 if the block is corrupt.
+ */
+static int lzDecompress(const unsigned char *src, size_t srcLen, unsigned char *dst, size_t len)
+{
+    const unsigned char *ip = src, *end = src + srcLen;
+    unsigned char *op = dst, *opEnd = dst + len;
+    while (ip < end) {
+        unsigned char token = *ip++;
+        size_t literalLength = token >> 4;
+        if (literalLength == 15 && ! lzReadLength(&ip, end, &literalLength)) {
+            return 0;
+        }
+        if ((size_t) (end - ip) < literalLength || (size_t) (opEnd - op) < literalLength) {
+            return 0;
+        }
+        memcpy(op, ip, literalLength);
+        ip += literalLength;
+        op += literalLength;
+        if (ip == end) {
+            break;
+        }
+        if (end - ip < 2) {
+            return 0;
+        }
+        size_t offset = ip[0] | (size_t) ip[1] << 8;
+        ip += 2;
+        size_t matchLength = token & 15;
+        if (matchLength == 15 && ! lzReadLength(&ip, end, &matchLength)) {
+            return 0;
+        }
+        matchLength += LZ_MIN_MATCH;
+        if (! offset || offset > (size_t) (op - dst) || (size_t) (opEnd - op) < matchLength) {
+            return 0;
+        }
+        // An overlapping match repeats the last offset bytes: each copy doubles what can be copied at once.
+        const unsigned char *ref = op - offset;
+        while (matchLength) {
+            size_t chunk = (size_t) (op - ref) < matchLength ? (size_t) (op - ref) : matchLength;
+            memcpy(op, ref, chunk);
+            op += chunk;
+            matchLength -= chunk;
+        }
+    }
+    return op == opEnd;
+}
+
+int isCompressedJob(const char *job, size_t len)
+{
+    return len >= COMPRESSED_JOB_HEADER_SIZE && (unsigned char) job[0] == COMPRESSED_JOB_MAGIC;
+}
+
+size_t compressedJobBound(size_t len)
+{
+    return COMPRESSED_JOB_HEADER_SIZE + len + len / 255 + 16;
+}
+
+/**
+ * Compress a job whatever compress-size, if it gets smaller.
+ */
+static size_t compressJobOfAnySize(const char *job, size_t len, char *buffer)
+{
+    // A job too short to have a match only gets longer.
+    if (len <= LZ_LAST_LITERALS + LZ_MIN_MATCH || len > UINT32_MAX || isCompressedJob(job, len)) {
+        return 0;
+    }
+    unsigned char *header = (unsigned char *) buffer;
+    header[0] = COMPRESSED_JOB_MAGIC;
+    for (int i = 0; i < 4; ++i) {
+        header[1 + i] = (unsigned char) (len >> (8 * (3 - i)));
+    }
+    size_t compressed = COMPRESSED_JOB_HEADER_SIZE +
+                        lzCompress((const unsigned char *) job, len, header + COMPRESSED_JOB_HEADER_SIZE);
+    return compressed < len ? compressed : 0;
+}
+
+size_t compressJobToBuffer(const char *job, size_t len, char *buffer)
+{
+    if (! laravelQueueConfig.compressSize || (long long) len < laravelQueueConfig.compressSize) {
+        return 0;
+    }
+    return compressJobOfAnySize(job, len, buffer);
+}
+
+RedisModuleString * compressJob(RedisModuleCtx *ctx, RedisModuleString *job, QueueStats *stats)
+{
+    if (! laravelQueueConfig.compressSize) {
+        return NULL;
+    }
+    size_t len;
+    const char *str = RedisModule_StringPtrLen(job, &len);
+    if ((long long) len < laravelQueueConfig.compressSize) {
+        return NULL;
+    }
+    char *buffer = RedisModule_Alloc(compressedJobBound(len));
+    size_t compressed = compressJobToBuffer(str, len, buffer);
+    RedisModuleString *result = compressed ? RedisModule_CreateString(ctx, buffer, compressed) : NULL;
+    RedisModule_Free(buffer);
+    compressedJobsStored |= compressed != 0;
+    if (stats) {
+        stats->compressedJobs += compressed != 0;
+        stats->compressionInputBytes += (long long) len;
+        stats->compressionOutputBytes += (long long) (compressed ? compressed : len);
+    }
+    return result;
+}
+
+RedisModuleString * decompressJob(RedisModuleCtx *ctx, RedisModuleString *job)
+{
+    size_t len;
+    const char *str = RedisModule_StringPtrLen(job, &len);
+    if (! isCompressedJob(str, len)) {
+        return NULL;
+    }
+    compressedJobsStored = 1;
+    const unsigned char *header = (const unsigned char *) str;
+    size_t original = 0;
+    for (int i = 1; i < COMPRESSED_JOB_HEADER_SIZE; ++i) {
+        original = (original << 8) | header[i];
+    }
+    // The length is read from the job: a corrupt or forged one must not make us allocate more than it can hold.
+    if (original > (len - COMPRESSED_JOB_HEADER_SIZE) * LZ_MAX_EXPANSION) {
+        return NULL;
+    }
+    char *buffer = RedisModule_Alloc(original ? original : 1);
+    RedisModuleString *result = NULL;
+    if (lzDecompress(header + COMPRESSED_JOB_HEADER_SIZE, len - COMPRESSED_JOB_HEADER_SIZE,
+                     (unsigned char *) buffer, original)) {
+        result = RedisModule_CreateString(ctx, buffer, original);
+    }
+    RedisModule_Free(buffer);
+    return result;
+}
+
+RedisModuleString * storedJobOf(RedisModuleCtx *ctx, RedisModuleString *job, QueueStats *stats)
+{
+    RedisModuleString *envelope = wrapJobInEnvelope(ctx, job);
+    RedisModuleString *compressed = compressJob(ctx, envelope ? envelope : job, stats);
+    if (compressed && envelope) {
+        RedisModule_FreeString(ctx, envelope);
+    }
+    return compressed ? compressed : envelope;
+}
+
+RedisModuleString * compressedFormOf(RedisModuleCtx *ctx, RedisModuleString *job)
+{
+    if (! compressedJobsStored && ! laravelQueueConfig.compressSize) {
+        return NULL;
+    }
+    // Compressing the same job always gives the same block, so the job is found whatever compress-size was.
+    size_t len;
+    const char *str = RedisModule_StringPtrLen(job, &len);
+    char *buffer = RedisModule_Alloc(compressedJobBound(len));
+    size_t compressed = compressJobOfAnySize(str, len, buffer);
+    RedisModuleString *result = compressed ? RedisModule_CreateString(ctx, buffer, compressed) : NULL;
+    RedisModule_Free(buffer);
+    return result;
+}
+
+void noteStoredJob(RedisModuleString *job)
+{
+    size_t len;
+    const char *str = RedisModule_StringPtrLen(job, &len);
+    if (isCompressedJob(str, len)) {
+        compressedJobsStored = 1;
+    }
+}
+
+RedisModuleString * takeReservedNativeJob(RedisModuleCtx *ctx, JobHeap *heap, RedisModuleString *job)
+{
+    RedisModuleString *reserved = JobHeap_Take(heap, job);
+    if (reserved || JobHeap_IsId(heap, job)) {
+        return reserved;
+    }
+    RedisModuleString *compressed = compressedFormOf(ctx, job);
+    if (compressed) {
+        reserved = JobHeap_Take(heap, compressed);
+        RedisModule_FreeString(ctx, compressed);
+    }
+    return reserved;
+}
+
+JobHeapEntry * findReservedNativeJob(RedisModuleCtx *ctx, JobHeap *heap, RedisModuleString *job)
+{
+    JobHeapEntry *entry = JobHeap_Find(heap, job);
+    if (entry || JobHeap_IsId(heap, job)) {
+        return entry;
+    }
+    RedisModuleString *compressed = compressedFormOf(ctx, job);
+    if (compressed) {
+        entry = JobHeap_Find(heap, compressed);
+        RedisModule_FreeString(ctx, compressed);
+    }
+    return entry;
+}
+
+RedisModuleString * removeReservedMember(RedisModuleCtx *ctx, RedisModuleKey *reserved, RedisModuleString *job)
+{
+    int deleted = 0;
+    RedisModule_ZsetRem(reserved, job, &deleted);
+    if (deleted) {
+        return job;
+    }
+    RedisModuleString *compressed = compressedFormOf(ctx, job);
+    if (compressed) {
+        RedisModule_ZsetRem(reserved, compressed, &deleted);
+        if (deleted) {
+            return compressed;
+        }
+        RedisModule_FreeString(ctx, compressed);
+    }
+    return NULL;
+}
+
+RedisModuleString * findReservedMember(RedisModuleCtx *ctx, RedisModuleKey *reserved, RedisModuleString *job)
+{
+    double score;
+    if (RedisModule_ZsetScore(reserved, job, &score) == REDISMODULE_OK) {
+        return job;
+    }
+    RedisModuleString *compressed = compressedFormOf(ctx, job);
+    if (compressed) {
+        if (RedisModule_ZsetScore(reserved, compressed, &score) == REDISMODULE_OK) {
+            return compressed;
+        }
+        RedisModule_FreeString(ctx, compressed);
+    }
+    return NULL;
+}
@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2018, Hamid Alaei Varnosfaderani
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LARAVEL_QUEUE_COMPRESSION_H
+#define LARAVEL_QUEUE_COMPRESSION_H
+
+#include "redismodule.h"
+#include "stats.h"
+
+struct JobHeap;
+struct JobHeapEntry;
+
+/**
+ * A compressed job is 0xFE, the length of the job as a 4-byte big-endian integer, then an LZ77 block:
+ * sequences of a token (literal length in the high and match length - 4 in the low nibble, each extended by
+ * bytes of 255 when it is 15), the literals, and a 2-byte little-endian match offset. The last sequence has
+ * literals only. Neither a json job nor an envelope starts with 0xFE.
+ */
+#define COMPRESSED_JOB_MAGIC 0xfe
+#define COMPRESSED_JOB_HEADER_SIZE 5
+
+/**
+ * Whether a job is compressed.
+ *
+ * @param job
+ * @param len
+ */
+int isCompressedJob(const char *job, size_t len);
+
+/**
+ * Size of the buffer to compress a job of len bytes into.
+ *
+ * @param len
+ */
+size_t compressedJobBound(size_t len);
+
+/**
+ * Compress a job into the buffer, if it is at least compress-size bytes long and gets smaller.
+ * The buffer must be at least compressedJobBound(len) bytes long. Safe to call off the main thread.
+ *
+ * @param job
+ * @param len
+ * @param buffer
+ * @return length of the compressed job, or 0 to store the job as is.
+ */
+size_t compressJobToBuffer(const char *job, size_t len, char *buffer);
+
+/**
+ * Compress a job, if it is at least compress-size bytes long and gets smaller.
+ *
+ * @param ctx
+ * @param job
+ * @param stats the counters of the queue the job is pushed to, or NULL.
+ * @return the compressed job to be freed, or NULL to store the job as is.
+ */
+RedisModuleString * compressJob(RedisModuleCtx *ctx, RedisModuleString *job, QueueStats *stats);
+
+/**
+ * Decompress a job.
+ *
+ * @param ctx
+ * @param job
+ * @return the decompressed job to be freed, or NULL if the job is not compressed or is corrupt.
+ */
+RedisModuleString * decompressJob(RedisModuleCtx *ctx, RedisModuleString *job);
+
+/**
+ * The form a pushed job is stored in: wrapped in an envelope and then compressed, depending on the options.
+ *
+ * @param ctx
+ * @param job
+ * @param stats the counters of the queue the job is pushed to.
+ * @return the stored job to be freed, or NULL to store the job as is.
+ */
+RedisModuleString * storedJobOf(RedisModuleCtx *ctx, RedisModuleString *job, QueueStats *stats);
+
+/**
+ * The compressed form a job given by a worker may be stored as, whatever compress-size was when it was stored.
+ * Only worth looking up when the job as given is not found.
+ *
+ * @param ctx
+ * @param job
+ * @return the compressed job to be freed, or NULL if no compressed job may be stored or the job doesn't get smaller.
+ */
+RedisModuleString * compressedFormOf(RedisModuleCtx *ctx, RedisModuleString *job);
+
+/**
+ * Note a job stored by other means than compressJob(), e.g. loaded or replicated, in case it is compressed.
+ *
+ * @param job
+ */
+void noteStoredJob(RedisModuleString *job);
+
+/**
+ * Take a job given by a worker from the reserved jobs of a native queue, whether it is reserved as given or compressed.
+ *
+ * @param ctx
+ * @param heap
+ * @param job the job, or its id if the heap is indexed by id.
+ * @return the reserved job to be freed, or NULL if it is not reserved.
+ */
+RedisModuleString * takeReservedNativeJob(RedisModuleCtx *ctx, struct JobHeap *heap, RedisModuleString *job);
+
+/**
+ * Find a job given by a worker in the reserved jobs of a native queue, whether it is reserved as given or compressed.
+ *
+ * @param ctx
+ * @param heap
+ * @param job the job, or its id if the heap is indexed by id.
+ * @return
+ */
+struct JobHeapEntry * findReservedNativeJob(RedisModuleCtx *ctx, struct JobHeap *heap, RedisModuleString *job);
+
+/**
+ * Remove a job given by a worker from a sorted set of reserved jobs, whether it is reserved as given or compressed.
+ *
+ * @param ctx
+ * @param reserved
+ * @param job
+ * @return the removed member: the job, or its compressed form to be freed. NULL if it is not reserved.
+ */
+RedisModuleString * removeReservedMember(RedisModuleCtx *ctx, RedisModuleKey *reserved, RedisModuleString *job);
+
+/**
+ * Find a job given by a worker in a sorted set of reserved jobs, whether it is reserved as given or compressed.
+ *
+ * @param ctx
+ * @param reserved
+ * @param job
+ * @return the member: the job, or its compressed form to be freed. NULL if it is not reserved.
+ */
+RedisModuleString * findReservedMember(RedisModuleCtx *ctx, RedisModuleKey *reserved, RedisModuleString *job);
+
+#endif //LARAVEL_QUEUE_COMPRESSION_H
@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2018, Hamid Alaei Varnosfaderani
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "config.h"
+
+#include <limits.h>
+#include <strings.h>
+
+LaravelQueueConfig laravelQueueConfig = {
+        .nativeType = 0,
+        .jobEnvelope = 0,
+        .reserveById = 0,
+        .offloadThreads = 0,
+        .offloadSize = 65536,
+        .compressSize = 0,
+};
+
+static int parseBoolean(RedisModuleString *value, int *result)
+{
+    const char *str = RedisModule_StringPtrLen(value, NULL);
+    if (! strcasecmp(str, "yes")) {
+        *result = 1;
+    } else if (! strcasecmp(str, "no")) {
+        *result = 0;
+    } else {
+        return REDISMODULE_ERR;
+    }
+    return REDISMODULE_OK;
+}
+
+static int parseInteger(RedisModuleString *value, long long min, long long max, long long *result)
+{
+    long long ll;
+    if (RedisModule_StringToLongLong(value, &ll) != REDISMODULE_OK || ll < min || ll > max) {
+        return REDISMODULE_ERR;
+    }
+    *result = ll;
+    return REDISMODULE_OK;
+}
+
+/**
+ * Parse the module arguments.
+ *
+ * @param ctx
+ * @param argv
+ * @param argc
+ * @return REDISMODULE_OK or REDISMODULE_ERR on invalid arguments.
+ */
+int parseModuleArguments(RedisModuleCtx *ctx, RedisModuleString **argv, int argc)
+{
+    if (argc % 2) {
+        RedisModule_Log(ctx, "warning", "Module arguments must be name-value pairs");
+        return REDISMODULE_ERR;
+    }
+    for (int i = 0; i < argc; i += 2) {
+        const char *name = RedisModule_StringPtrLen(argv[i], NULL);
+        int valid;
+        if (! strcasecmp(name, "native-type")) {
+            valid = parseBoolean(argv[i + 1], &laravelQueueConfig.nativeType);
+        } else if (! strcasecmp(name, "job-envelope")) {
+            valid = parseBoolean(argv[i + 1], &laravelQueueConfig.jobEnvelope);
+        } else if (! strcasecmp(name, "reserve-by-id")) {
+            valid = parseBoolean(argv[i + 1], &laravelQueueConfig.reserveById);
+        } else if (! strcasecmp(name, "offload-threads")) {
+            long long threads = 0;
+            valid = parseInteger(argv[i + 1], 0, 64, &threads);
+            laravelQueueConfig.offloadThreads = (int) threads;
+        } else if (! strcasecmp(name, "offload-size")) {
+            valid = parseInteger(argv[i + 1], 1, LLONG_MAX, &laravelQueueConfig.offloadSize);
+        } else if (! strcasecmp(name, "compress-size")) {
+            valid = parseInteger(argv[i + 1], 0, LLONG_MAX, &laravelQueueConfig.compressSize);
+        } else {
+            RedisModule_Log(ctx, "warning", "Unknown module argument: %s", name);
+            return REDISMODULE_ERR;
+        }
+        if (valid != REDISMODULE_OK) {
+            RedisModule_Log(ctx, "warning", "Invalid value for module argument %s", name);
+            return REDISMODULE_ERR;
+        }
+    }
+    if (laravelQueueConfig.reserveById && ! laravelQueueConfig.nativeType) {
+        RedisModule_Log(ctx, "warning", "reserve-by-id only applies to native queues, see native-type");
+    }
+    return REDISMODULE_OK;
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2018, Hamid Alaei Varnosfaderani
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef LARAVEL_QUEUE_CONFIG_H
+#define LARAVEL_QUEUE_CONFIG_H
+
+#include "redismodule.h"
+
+/**
+ * Module options, given as name-value pairs to loadmodule.
+ */
+typedef struct LaravelQueueConfig
+{
+    /**
+     * Store new queues in a single native laravel-q key instead of a list and two sorted sets.
+     */
+    int nativeType;
+
+    /**
+     * Wrap pushed jobs in envelopes that keep their attempts outside the json.
+     */
+    int jobEnvelope;
+
+    /**
+     * Index the reserved jobs of native queues by their job id, so they can be deleted or released by id.
+     */
+    int reserveById;
+
+    /**
+     * Number of threads that rewrite the attempts of large jobs, 0 to rewrite all jobs on the main thread.
+     */
+    int offloadThreads;
+
+    /**
+     * Jobs of at least this many bytes are rewritten by the offload threads.
+     */
+    long long offloadSize;
+
+    /**
+     * Jobs of at least this many bytes are stored compressed, 0 to store all jobs as they are pushed.
+     */
+    long long compressSize;
+} LaravelQueueConfig;
+
+extern LaravelQueueConfig laravelQueueConfig;
+
+/**
+ * Parse the module arguments.
+ *
+ * @param ctx
+ * @param argv
+ * @param argc
+ * @return REDISMODULE_OK or REDISMODULE_ERR on invalid arguments.
+ */
+int parseModuleArguments(RedisModuleCtx *ctx, RedisModuleString **argv, int argc);
+
+#endif //LARAVEL_QUEUE_CONFIG_H
@@ -30,32 +30,6 @@
 
 #include "containers.h"
 
-/**
- * Create a doubly linked list.
- */
-DLList * DLList_Create()
-{
-    DLList *list = RedisModule_Alloc(sizeof(DLList));
-    list->size = 0;
-    list->front = list->back = NULL;
-    return list;
-}
-
-/**
- * Delete a doubly linked list.
- */
-void DLList_Drop(DLList *list, void (*del)(DLNode *, void *), void *param)
-{
-    while (list->front) {
-        DLNode *front = list->front;
-        DLList_Delete(list, front);
-        if (del) {
-            del(front, param);
-        }
-    }
-    RedisModule_Free(list);
-}
-
 /**
  * Push a node to the front of the list.
  *
@@ -118,175 +92,3 @@ void DLList_Delete(DLList *list, DLNode *node)
 
     list->size--;
 }
-
-/**
- * Create a doulby linked dictionary.
- */
-DLDictionary * DLDictionary_Create()
-{
-    DLDictionary *dictionary = RedisModule_Alloc(sizeof(DLDictionary));
-    dictionary->list = DLList_Create();
-    dictionary->dict = RedisModule_CreateDict(NULL);
-    return dictionary;
-}
-
-typedef struct DelParam
-{
-    void (*del)(RedisModuleString *key, void *value, void *param);
-    void *param;
-    RedisModuleDict *dict;
-} DelParam;
-
-/**
- * Delete a doubly linked dictionary.
- *
- * @param dictionary
- * @param del function to be called on every deleted key-value.
- * @param param to pass to del function.
- */
-void DLDictionary_Drop(DLDictionary *dictionary, void (*del)(RedisModuleString *key, void *value, void *param), void *param)
-{
-    DLNode *node;
-    while (node = dictionary->list->front) {
-        DLDKeyValue *pair = node->data;
-        DLDictionary_Delete(dictionary, pair->key);
-        if (del) {
-            del(pair->key, pair->value, param);
-        }
-    }
-    RedisModule_Free(dictionary->list);
-    RedisModule_FreeDict(NULL, dictionary->dict);
-    RedisModule_Free(dictionary);
-}
-
-/**
- * Set value for a given key.
- *
- * @param dictionary
- * @param key
- * @param value
- * @param front
- * @return
- */
-void * DLDictionary_Set(DLDictionary *dictionary, RedisModuleString *key, void *value, int front)
-{
-    DLNode *node = RedisModule_DictGet(dictionary->dict, key, NULL);
-    DLDKeyValue *pair;
-    if (node) {
-        pair = node->data;
-        void *old = pair->value;
-        pair->value = value;
-        return old;
-    }
-
-    pair = RedisModule_Alloc(sizeof(DLDKeyValue));
-    node = RedisModule_Alloc(sizeof(DLNode));
-
-    pair->key = key;
-    pair->value = value;
-    node->data = pair;
-
-    RedisModule_DictSet(dictionary->dict, key, node);
-    if (front) {
-        DLList_Push_Front(dictionary->list, node);
-    } else {
-        DLList_Push_Back(dictionary->list, node);
-    }
-
-    return NULL;
-}
-
-/**
- * Set value for a given key.
- * If the key exists, it replaces the value.
- * If the key doesn't exists, it adds the key-value to the front of the dictionary.
- *
- * @param dictionary
- * @param key
- * @param value
- * @return null on insert, the previous value on update.
- */
-void * DLDictionary_Set_Front(DLDictionary *dictionary, RedisModuleString *key, void *value)
-{
-    return DLDictionary_Set(dictionary, key, value, 1);
-}
-
-/**
- * Set value for a given key.
- * If the key exists, it replaces the value.
- * If the key doesn't exists, it adds the key-value to the back of the dictionary.
- *
- * @param dictionary
- * @param key
- * @param value
- * @return null on insert, the previous value on update.
- */
-void * DLDictionary_Set_Back(DLDictionary *dictionary, RedisModuleString *key, void *value)
-{
-    return DLDictionary_Set(dictionary, key, value, 0);
-}
-
-/**
- * Get the value of a given key.
- *
- * @param dictionary
- * @param key
- * @return value
- */
-void * DLDictionary_Get(DLDictionary *dictionary, RedisModuleString *key)
-{
-    DLNode *node = RedisModule_DictGet(dictionary->dict, key, NULL);
-    if (node) {
-        DLDKeyValue *pair = node->data;
-        return pair->value;
-    }
-    return NULL;
-}
-
-/**
- * Get the key-value of the front of the dictionary.
- *
- * @param dictionary
- * @return
- */
-DLDKeyValue * DLDictionary_Front(DLDictionary *dictionary)
-{
-    if (dictionary->list->front) {
-        return dictionary->list->front->data;
-    }
-    return NULL;
-}
-
-/**
- * Get the key-value of the back of the dictionary.
- *
- * @param dictionary
- * @return
- */
-DLDKeyValue * DLDictionary_Back(DLDictionary *dictionary)
-{
-    if (dictionary->list->back) {
-        return dictionary->list->back->data;
-    }
-    return NULL;
-}
-
-/**
- * Delete a key from dictionary
- * @param dictionary
- * @param key
- * @return the corresponding value if key exists, otherwise null.
- */
-void * DLDictionary_Delete(DLDictionary *dictionary, RedisModuleString *key)
-{
-    DLNode *node;
-    if (RedisModule_DictDel(dictionary->dict, key, &node) == REDISMODULE_OK) {
-        DLList_Delete(dictionary->list, node);
-        DLDKeyValue *pair = node->data;
-        void *value = pair->value;
-        RedisModule_Free(pair);
-        RedisModule_Free(node);
-        return value;
-    }
-    return NULL;
-}
@@ -53,20 +53,6 @@ typedef struct DLList
     DLNode *back;
 } DLList;
 
-/**
- * Create a doubly linked list.
- */
-DLList * DLList_Create();
-
-/**
- * Delete a doubly linked list.
- *
- * @param list
- * @param del function to be called on every deleted node.
- * @param param to pass to del function.
- */
-void DLList_Drop(DLList *list, void (*del)(DLNode *, void *), void *param);
-
 /**
  * Push a node to the front of the list.
  *
@@ -91,93 +77,4 @@ void DLList_Push_Back(DLList *list, DLNode *node);
  */
 void DLList_Delete(DLList *list, DLNode *node);
 
-/**
- * Double linked dictionary
- */
-typedef struct DLDictionary
-{
-    RedisModuleDict *dict;
-    DLList *list;
-} DLDictionary;
-
-/**
- * Key-value pair
- */
-typedef struct DLDKeyValue
-{
-    RedisModuleString *key;
-    void *value;
-} DLDKeyValue;
-
-/**
- * Create a doulby linked dictionary.
- */
-DLDictionary * DLDictionary_Create();
-
-/**
- * Delete a doubly linked dictionary.
- *
- * @param dictionary
- * @param del function to be called on every deleted key-value.
- * @param param to pass to del function.
- */
-void DLDictionary_Drop(DLDictionary *dictionary, void (*del)(RedisModuleString *key, void *value, void *param), void *param);
-
-/**
- * Set value for a given key.
- * If the key exists, it replaces the value.
- * If the key doesn't exists, it adds the key-value to the front of the dictionary.
- *
- * @param dictionary
- * @param key
- * @param value
- * @return null on insert, the previous value on update.
- */
-void * DLDictionary_Set_Front(DLDictionary *dictionary, RedisModuleString *key, void *value);
-
-/**
- * Set value for a given key.
- * If the key exists, it replaces the value.
- * If the key doesn't exists, it adds the key-value to the back of the dictionary.
- *
- * @param dictionary
- * @param key
- * @param value
- * @return null on insert, the previous value on update.
- */
-void * DLDictionary_Set_Back(DLDictionary *dictionary, RedisModuleString *key, void *value);
-
-/**
- * Get the value of a given key.
- *
- * @param dictionary
- * @param key
- * @return value
- */
-void * DLDictionary_Get(DLDictionary *dictionary, RedisModuleString *key);
-
-/**
- * Get the key-value of the front of the dictionary.
- *
- * @param dictionary
- * @return
- */
-DLDKeyValue * DLDictionary_Front(DLDictionary *dictionary);
-
-/**
- * Get the key-value of the back of the dictionary.
- *
- * @param dictionary
- * @return
- */
-DLDKeyValue * DLDictionary_Back(DLDictionary *dictionary);
-
-/**
- * Delete a key from dictionary
- * @param dictionary
- * @param key
- * @return the corresponding value if key exists, otherwise null.
- */
-void * DLDictionary_Delete(DLDictionary *dictionary, RedisModuleString *key);
-
 #endif //LARAVEL_QUEUE_CONTAINERS_H
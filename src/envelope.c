@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2018, Hamid Alaei Varnosfaderani
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "envelope.h"
+
+#include <stdint.h>
+#include <string.h>
+#include "blocking-pop.h"
+#include "compression.h"
+#include "config.h"
+
+#define JOB_ENVELOPE_MAX_ATTEMPTS 0xffffffffll
+
+static void writeBigEndian(unsigned char *p, uint64_t value, int bytes)
+{
+    for (int i = bytes - 1; i >= 0; --i) {
+        p[i] = (unsigned char) value;
+        value >>= 8;
+    }
+}
+
+static uint64_t readBigEndian(const unsigned char *p, int bytes)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; ++i) {
+        value = (value << 8) | p[i];
+    }
+    return value;
+}
+
+int isJobEnvelope(const char *job, size_t len)
+{
+    return len >= JOB_ENVELOPE_HEADER_SIZE && (unsigned char) job[0] == JOB_ENVELOPE_MAGIC &&
+           job[1] == JOB_ENVELOPE_VERSION;
+}
+
+int isAcceptedJob(RedisModuleString *job)
+{
+    size_t len;
+    const char *str = RedisModule_StringPtrLen(job, &len);
+    if (len && (unsigned char) str[0] == COMPRESSED_JOB_MAGIC) {
+        return 0;
+    }
+    if (! len || (unsigned char) str[0] != JOB_ENVELOPE_MAGIC) {
+        return 1;
+    }
+    return laravelQueueConfig.jobEnvelope && isJobEnvelope(str, len);
+}
+
+size_t writeJobEnvelope(const char *body, size_t len, long long pushedAt, char *buffer)
+{
+    unsigned char *header = (unsigned char *) buffer;
+    header[0] = JOB_ENVELOPE_MAGIC;
+    header[1] = JOB_ENVELOPE_VERSION;
+    writeBigEndian(header + 2, 0, 4);
+    writeBigEndian(header + 6, (uint64_t) pushedAt, 8);
+    memcpy(buffer + JOB_ENVELOPE_HEADER_SIZE, body, len);
+    return len + JOB_ENVELOPE_HEADER_SIZE;
+}
+
+size_t writeIncrementedEnvelopeAttempts(const char *job, size_t len, char *buffer, long long *attempts)
+{
+    long long value = (long long) readBigEndian((const unsigned char *) job + 2, 4);
+    if (value < JOB_ENVELOPE_MAX_ATTEMPTS) {
+        value++;
+    }
+    memcpy(buffer, job, len);
+    writeBigEndian((unsigned char *) buffer + 2, (uint64_t) value, 4);
+    *attempts = value;
+    return len;
+}
+
+RedisModuleString * wrapJobInEnvelope(RedisModuleCtx *ctx, RedisModuleString *job)
+{
+    if (! laravelQueueConfig.jobEnvelope) {
+        return NULL;
+    }
+    size_t len;
+    const char *str = RedisModule_StringPtrLen(job, &len);
+    if (isJobEnvelope(str, len)) {
+        return NULL;
+    }
+    char *buffer = RedisModule_PoolAlloc(ctx, len + JOB_ENVELOPE_HEADER_SIZE);
+    return RedisModule_CreateString(ctx, buffer, writeJobEnvelope(str, len, ustime() / 1000, buffer));
+}
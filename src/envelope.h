@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2018, Hamid Alaei Varnosfaderani
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LARAVEL_QUEUE_ENVELOPE_H
+#define LARAVEL_QUEUE_ENVELOPE_H
+
+#include "redismodule.h"
+
+/**
+ * A job in an envelope is prefixed by a binary header, so its attempts are incremented without touching the body.
+ * The header is 0xFF, the version, the attempts as 4 bytes and the pushed-at milliseconds as 8 bytes,
+ * both big-endian. A json job never starts with 0xFF.
+ */
+#define JOB_ENVELOPE_MAGIC 0xff
+#define JOB_ENVELOPE_VERSION 1
+#define JOB_ENVELOPE_HEADER_SIZE 14
+
+#define INVALID_JOB_ERROR "ERR INVALID JOB (0xFE is reserved, and only job envelopes can start with 0xFF, if job-envelope is on)"
+
+/**
+ * Whether a job is in an envelope.
+ *
+ * @param job
+ * @param len
+ */
+int isJobEnvelope(const char *job, size_t len);
+
+/**
+ * Whether a job given by a client can be stored. Stored envelopes and compressed jobs are decoded whatever the
+ * options, so no other job may look like one.
+ *
+ * @param job
+ */
+int isAcceptedJob(RedisModuleString *job);
+
+/**
+ * Write a job in an envelope with 0 attempts.
+ * The buffer must be at least len + JOB_ENVELOPE_HEADER_SIZE bytes long.
+ *
+ * @param body
+ * @param len
+ * @param pushedAt in milliseconds.
+ * @param buffer
+ * @return length of the written envelope.
+ */
+size_t writeJobEnvelope(const char *body, size_t len, long long pushedAt, char *buffer);
+
+/**
+ * Write an envelope with its attempts incremented into the buffer.
+ * The buffer must be at least len bytes long.
+ *
+ * @param job
+ * @param len
+ * @param buffer
+ * @param attempts set to the incremented attempts.
+ * @return length of the written envelope.
+ */
+size_t writeIncrementedEnvelopeAttempts(const char *job, size_t len, char *buffer, long long *attempts);
+
+/**
+ * Wrap a pushed job in an envelope, if the job-envelope option is on and it is not in one already.
+ *
+ * @param ctx
+ * @param job
+ * @return the envelope to be freed, or NULL to push the job as is.
+ */
+RedisModuleString * wrapJobInEnvelope(RedisModuleCtx *ctx, RedisModuleString *job);
+
+#endif //LARAVEL_QUEUE_ENVELOPE_H
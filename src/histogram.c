@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2018, Hamid Alaei Varnosfaderani
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+#include "histogram.h"
+
+static int bucketOf(uint64_t value)
+{
+    if (value < HISTOGRAM_SUB_BUCKETS) {
+        return (int) value;
+    }
+    int shift = 63 - __builtin_clzll(value) - HISTOGRAM_SUB_BUCKET_BITS;
+    return (shift + 1) * HISTOGRAM_SUB_BUCKETS + (int) ((value >> shift) - HISTOGRAM_SUB_BUCKETS);
+}
+
+static uint64_t highestValueOf(int bucket)
+{
+    if (bucket < HISTOGRAM_SUB_BUCKETS) {
+        return (uint64_t) bucket;
+    }
+    int shift = bucket / HISTOGRAM_SUB_BUCKETS - 1;
+    uint64_t lowest = (uint64_t) (HISTOGRAM_SUB_BUCKETS + bucket % HISTOGRAM_SUB_BUCKETS) << shift;
+    return lowest + (1ull << shift) - 1;
+}
+
+void Histogram_Reset(Histogram *histogram)
+{
+    memset(histogram, 0, sizeof(Histogram));
+}
+
+void Histogram_Record(Histogram *histogram, long long value)
+{
+    uint64_t v = value < 0 ? 0 : (uint64_t) value;
+    if (v > HISTOGRAM_MAX_VALUE) {
+        v = HISTOGRAM_MAX_VALUE;
+    }
+    histogram->counts[bucketOf(v)]++;
+    if (! histogram->total || v < histogram->min) {
+        histogram->min = v;
+    }
+    if (v > histogram->max) {
+        histogram->max = v;
+    }
+    histogram->total++;
+}
+
+uint64_t Histogram_Quantile(Histogram *histogram, double quantile)
+{
+    if (! histogram->total) {
+        return 0;
+    }
+    if (quantile <= 0) {
+        return histogram->min;
+    }
+    // The rank of the quantile, rounded up.
+    double exact = quantile * histogram->total;
+    uint64_t rank = (uint64_t) exact;
+    if (rank < exact || rank < 1) {
+        rank++;
+    }
+    uint64_t seen = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+        seen += histogram->counts[i];
+        if (seen >= rank) {
+            uint64_t value = highestValueOf(i);
+            return value < histogram->max ? value : histogram->max;
+        }
+    }
+    return histogram->max;
+}
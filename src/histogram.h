@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2018, Hamid Alaei Varnosfaderani
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LARAVEL_QUEUE_HISTOGRAM_H
+#define LARAVEL_QUEUE_HISTOGRAM_H
+
+#include <stdint.h>
+
+/**
+ * Values below 2^HISTOGRAM_SUB_BUCKET_BITS have their own buckets.
+ * Above that, every power of two is split into 2^HISTOGRAM_SUB_BUCKET_BITS linear buckets,
+ * so a recorded value is off by less than 1/16 of itself.
+ */
+#define HISTOGRAM_SUB_BUCKET_BITS 4
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BUCKET_BITS)
+
+/**
+ * Larger values are recorded as the maximum value.
+ */
+#define HISTOGRAM_MAX_VALUE ((1ull << 40) - 1)
+
+#define HISTOGRAM_BUCKETS ((40 - HISTOGRAM_SUB_BUCKET_BITS + 1) * HISTOGRAM_SUB_BUCKETS)
+
+/**
+ * Log-bucketed histogram of non-negative values.
+ */
+typedef struct Histogram
+{
+    uint64_t counts[HISTOGRAM_BUCKETS];
+    uint64_t total;
+    uint64_t min;
+    uint64_t max;
+} Histogram;
+
+/**
+ * Remove all the recorded values.
+ *
+ * @param histogram
+ */
+void Histogram_Reset(Histogram *histogram);
+
+/**
+ * Record a value. Negative values are recorded as 0.
+ *
+ * @param histogram
+ * @param value
+ */
+void Histogram_Record(Histogram *histogram, long long value);
+
+/**
+ * Get the value at a quantile.
+ *
+ * @param histogram
+ * @param quantile between 0 and 1.
+ * @return the highest value equivalent to the bucket of the quantile, or 0 if the histogram is empty.
+ */
+uint64_t Histogram_Quantile(Histogram *histogram, double quantile);
+
+#endif //LARAVEL_QUEUE_HISTOGRAM_H
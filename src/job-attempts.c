@@ -0,0 +1,469 @@
+/*
+ * Copyright (c) 2018, Hamid Alaei Varnosfaderani
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "job-attempts.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define JOB_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+/**
+ * Deeper jobs are left to the full json parser.
+ */
+#define JOB_MAX_DEPTH 64
+
+/**
+ * Larger attempts are left to the full json parser, so that they are incremented the same way.
+ */
+#define JOB_MAX_ATTEMPTS_DIGITS 9
+
+static const char * skipValue(const char *p, const char *end, int depth);
+
+/*
+ * Most of a job is made of long strings (the serialized command), so the string scanner looks for
+ * the next quote, backslash or control character a word or a vector at a time.
+ */
+
+#define ONES_64 0x0101010101010101ull
+#define HIGHS_64 0x8080808080808080ull
+
+/**
+ * Find the next quote, backslash or control character, 8 bytes at a time.
+ */
+static const char * findStringSpecialWord(const char *p, const char *end)
+{
+    while (end - p >= 8) {
+        uint64_t w;
+        memcpy(&w, p, 8);
+        uint64_t quote = w ^ (ONES_64 * '"');
+        uint64_t backslash = w ^ (ONES_64 * '\\');
+        uint64_t special = ((quote - ONES_64) & ~quote)
+                | ((backslash - ONES_64) & ~backslash)
+                | ((w - ONES_64 * 0x20) & ~w);
+        if (special & HIGHS_64) {
+            break;
+        }
+        p += 8;
+    }
+    while (p < end && *p != '"' && *p != '\\' && (unsigned char) *p >= 0x20) {
+        p++;
+    }
+    return p;
+}
+
+#ifdef JOB_SCAN_X86
+
+static const char * findStringSpecialSSE2(const char *p, const char *end)
+{
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x1F);
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *) p);
+        __m128i special = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+                _mm_cmpeq_epi8(_mm_min_epu8(v, control), v));
+        int mask = _mm_movemask_epi8(special);
+        if (mask) {
+            return p + __builtin_ctz((unsigned) mask);
+        }
+        p += 16;
+    }
+    return findStringSpecialWord(p, end);
+}
+
+__attribute__((target("avx2")))
+static const char * findStringSpecialAVX2(const char *p, const char *end)
+{
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i control = _mm256_set1_epi8(0x1F);
+    while (end - p >= 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *) p);
+        __m256i special = _mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpeq_epi8(v, quote), _mm256_cmpeq_epi8(v, backslash)),
+                _mm256_cmpeq_epi8(_mm256_min_epu8(v, control), v));
+        unsigned mask = (unsigned) _mm256_movemask_epi8(special);
+        if (mask) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 32;
+    }
+    return findStringSpecialSSE2(p, end);
+}
+
+#endif
+
+/**
+ * The string scanner for the current cpu, only set by initJobAttempts() before the offload threads start,
+ * and read-only afterwards.
+ */
+static const char * (*findStringSpecial)(const char *, const char *) = findStringSpecialWord;
+
+void initJobAttempts(void)
+{
+#ifdef JOB_SCAN_X86
+    __builtin_cpu_init();
+    findStringSpecial = __builtin_cpu_supports("avx2") ? findStringSpecialAVX2 : findStringSpecialSSE2;
+#endif
+}
+
+static const char * skipWhitespace(const char *p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+        p++;
+    }
+    return p;
+}
+
+static int isHex(char c)
+{
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+/**
+ * Skip a json string.
+ *
+ * @param p the opening quote.
+ * @param end
+ * @return pointer after the closing quote, or NULL if the string is invalid.
+ */
+static const char * skipString(const char *p, const char *end)
+{
+    for (p++; (p = findStringSpecial(p, end)) < end; p++) {
+        unsigned char c = (unsigned char) *p;
+        if (c == '"') {
+            return p + 1;
+        }
+        if (c < 0x20) {
+            return NULL;
+        }
+        if (++p == end) {
+            return NULL;
+        }
+        switch (*p) {
+            case '"': case '\\': case '/': case 'b': case 'f': case 'n': case 'r': case 't':
+                break;
+            case 'u':
+                if (end - p < 5 || ! isHex(p[1]) || ! isHex(p[2]) || ! isHex(p[3]) || ! isHex(p[4])) {
+                    return NULL;
+                }
+                p += 4;
+                break;
+            default:
+                return NULL;
+        }
+    }
+    return NULL;
+}
+
+static const char * skipDigits(const char *p, const char *end)
+{
+    const char *start = p;
+    while (p < end && *p >= '0' && *p <= '9') {
+        p++;
+    }
+    return p == start ? NULL : p;
+}
+
+static const char * skipNumber(const char *p, const char *end)
+{
+    if (p < end && *p == '-') {
+        p++;
+    }
+    if (p < end && *p == '0') {
+        p++;
+    } else if (! (p = skipDigits(p, end))) {
+        return NULL;
+    }
+    if (p < end && *p == '.') {
+        if (! (p = skipDigits(p + 1, end))) {
+            return NULL;
+        }
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+        if (p < end && (*p == '+' || *p == '-')) {
+            p++;
+        }
+        if (! (p = skipDigits(p, end))) {
+            return NULL;
+        }
+    }
+    return p;
+}
+
+static const char * skipLiteral(const char *p, const char *end, const char *literal, size_t len)
+{
+    if ((size_t) (end - p) < len || memcmp(p, literal, len)) {
+        return NULL;
+    }
+    return p + len;
+}
+
+static const char * skipObject(const char *p, const char *end, int depth)
+{
+    p = skipWhitespace(p + 1, end);
+    if (p < end && *p == '}') {
+        return p + 1;
+    }
+    while (p < end) {
+        if (*p != '"' || ! (p = skipString(p, end))) {
+            return NULL;
+        }
+        p = skipWhitespace(p, end);
+        if (p == end || *p != ':') {
+            return NULL;
+        }
+        if (! (p = skipValue(skipWhitespace(p + 1, end), end, depth))) {
+            return NULL;
+        }
+        p = skipWhitespace(p, end);
+        if (p < end && *p == '}') {
+            return p + 1;
+        }
+        if (p == end || *p != ',') {
+            return NULL;
+        }
+        p = skipWhitespace(p + 1, end);
+    }
+    return NULL;
+}
+
+static const char * skipArray(const char *p, const char *end, int depth)
+{
+    p = skipWhitespace(p + 1, end);
+    if (p < end && *p == ']') {
+        return p + 1;
+    }
+    while (p < end) {
+        if (! (p = skipValue(p, end, depth))) {
+            return NULL;
+        }
+        p = skipWhitespace(p, end);
+        if (p < end && *p == ']') {
+            return p + 1;
+        }
+        if (p == end || *p != ',') {
+            return NULL;
+        }
+        p = skipWhitespace(p + 1, end);
+    }
+    return NULL;
+}
+
+/**
+ * Skip a json value.
+ *
+ * @param p the first character of the value.
+ * @param end
+ * @param depth nesting level of the value.
+ * @return pointer after the value, or NULL if the value is invalid.
+ */
+static const char * skipValue(const char *p, const char *end, int depth)
+{
+    if (p == end) {
+        return NULL;
+    }
+    switch (*p) {
+        case '"':
+            return skipString(p, end);
+        case '{':
+            return depth < JOB_MAX_DEPTH ? skipObject(p, end, depth + 1) : NULL;
+        case '[':
+            return depth < JOB_MAX_DEPTH ? skipArray(p, end, depth + 1) : NULL;
+        case 't':
+            return skipLiteral(p, end, "true", 4);
+        case 'f':
+            return skipLiteral(p, end, "false", 5);
+        case 'n':
+            return skipLiteral(p, end, "null", 4);
+        default:
+            return skipNumber(p, end);
+    }
+}
+
+/**
+ * Parse the value of attempts if it is a small integer.
+ */
+static int parseAttempts(const char *p, const char *end, long long *value)
+{
+    int negative = 0;
+    if (*p == '-') {
+        negative = 1;
+        p++;
+    }
+    if (end - p > JOB_MAX_ATTEMPTS_DIGITS) {
+        return 0;
+    }
+    long long v = 0;
+    for (; p < end; p++) {
+        if (*p < '0' || *p > '9') {
+            return 0;
+        }
+        v = v * 10 + (*p - '0');
+    }
+    *value = negative ? -v : v;
+    return 1;
+}
+
+/**
+ * Scan a json job once to validate its structure and find its top-level integer "attempts".
+ *
+ * @param job
+ * @param len
+ * @param attempts
+ * @return 1 if found, 0 if the job should be handled by a full json parser.
+ */
+int findJobAttempts(const char *job, size_t len, JobAttempts *attempts)
+{
+    const char *end = job + len;
+    const char *p = skipWhitespace(job, end);
+    int found = 0;
+    if (p == end || *p != '{') {
+        return 0;
+    }
+    p = skipWhitespace(p + 1, end);
+    if (p < end && *p == '}') {
+        return 0;
+    }
+    while (p < end) {
+        const char *key = p;
+        if (*p != '"' || ! (p = skipString(p, end))) {
+            return 0;
+        }
+        int isAttempts = ! found && p - key == 10 && ! memcmp(key + 1, "attempts", 8);
+        p = skipWhitespace(p, end);
+        if (p == end || *p != ':') {
+            return 0;
+        }
+        const char *value = skipWhitespace(p + 1, end);
+        if (! (p = skipValue(value, end, 1))) {
+            return 0;
+        }
+        if (isAttempts) {
+            // The first attempts wins, the same way the json parser looks it up.
+            if (! parseAttempts(value, p, &attempts->value)) {
+                return 0;
+            }
+            attempts->start = value - job;
+            attempts->end = p - job;
+            found = 1;
+        }
+        p = skipWhitespace(p, end);
+        if (p < end && *p == '}') {
+            return found && skipWhitespace(p + 1, end) == end;
+        }
+        if (p == end || *p != ',') {
+            return 0;
+        }
+        p = skipWhitespace(p + 1, end);
+    }
+    return 0;
+}
+
+/**
+ * Write the job with its attempts incremented into the buffer.
+ * The buffer must be at least len + 1 bytes long.
+ *
+ * @param job
+ * @param len
+ * @param attempts
+ * @param buffer
+ * @return length of the written job.
+ */
+size_t writeIncrementedJobAttempts(const char *job, size_t len, const JobAttempts *attempts, char *buffer)
+{
+    char digits[24];
+    int n = snprintf(digits, sizeof(digits), "%lld", attempts->value + 1);
+    memcpy(buffer, job, attempts->start);
+    memcpy(buffer + attempts->start, digits, (size_t) n);
+    memcpy(buffer + attempts->start + n, job + attempts->end, len - attempts->end);
+    return attempts->start + n + len - attempts->end;
+}
+
+/**
+ * Scan a json job once to find its top-level string "id", the random id laravel gives to each pushed job.
+ *
+ * @param job
+ * @param len
+ * @param start set to the offset of the first character of the id.
+ * @param end set to the offset of the closing quote of the id.
+ * @return 1 if found, 0 if the job is invalid, has no id, or its id has escapes.
+ */
+int findJobId(const char *job, size_t len, size_t *start, size_t *end)
+{
+    const char *last = job + len;
+    const char *p = skipWhitespace(job, last);
+    int found = 0;
+    if (p == last || *p != '{') {
+        return 0;
+    }
+    p = skipWhitespace(p + 1, last);
+    while (p < last) {
+        const char *key = p;
+        if (*p != '"' || ! (p = skipString(p, last))) {
+            return 0;
+        }
+        int isId = ! found && p - key == 4 && ! memcmp(key + 1, "id", 2);
+        p = skipWhitespace(p, last);
+        if (p == last || *p != ':') {
+            return 0;
+        }
+        const char *value = skipWhitespace(p + 1, last);
+        if (! (p = skipValue(value, last, 1))) {
+            return 0;
+        }
+        if (isId) {
+            // The first id wins, the same way the json parser looks it up.
+            if (*value != '"' || memchr(value + 1, '\\', (size_t) (p - value - 2))) {
+                return 0;
+            }
+            *start = value + 1 - job;
+            *end = p - 1 - job;
+            found = 1;
+        }
+        p = skipWhitespace(p, last);
+        if (p < last && *p == '}') {
+            return found && skipWhitespace(p + 1, last) == last;
+        }
+        if (p == last || *p != ',') {
+            return 0;
+        }
+        p = skipWhitespace(p + 1, last);
+    }
+    return 0;
+}
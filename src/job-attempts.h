@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2018, Hamid Alaei Varnosfaderani
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef LARAVEL_QUEUE_JOB_ATTEMPTS_H
+#define LARAVEL_QUEUE_JOB_ATTEMPTS_H
+
+#include <stddef.h>
+
+/**
+ * Location of the top-level "attempts" number inside a json job.
+ */
+typedef struct JobAttempts
+{
+    size_t start;
+    size_t end;
+    long long value;
+} JobAttempts;
+
+/**
+ * Pick the fastest string scanner for the cpu. Must be called before the offload threads start, as they scan jobs too.
+ * Until then, jobs are scanned a word at a time.
+ */
+void initJobAttempts(void);
+
+/**
+ * Scan a json job once to validate its structure and find its top-level integer "attempts".
+ *
+ * @param job
+ * @param len
+ * @param attempts
+ * @return 1 if found, 0 if the job should be handled by a full json parser.
+ */
+int findJobAttempts(const char *job, size_t len, JobAttempts *attempts);
+
+/**
+ * Write the job with its attempts incremented into the buffer.
+ * The buffer must be at least len + 1 bytes long.
+ *
+ * @param job
+ * @param len
+ * @param attempts
+ * @param buffer
+ * @return length of the written job.
+ */
+size_t writeIncrementedJobAttempts(const char *job, size_t len, const JobAttempts *attempts, char *buffer);
+
+/**
+ * Scan a json job once to find its top-level string "id", the random id laravel gives to each pushed job.
+ *
+ * @param job
+ * @param len
+ * @param start set to the offset of the first character of the id.
+ * @param end set to the offset of the closing quote of the id.
+ * @return 1 if found, 0 if the job is invalid, has no id, or its id has escapes.
+ */
+int findJobId(const char *job, size_t len, size_t *start, size_t *end);
+
+#endif //LARAVEL_QUEUE_JOB_ATTEMPTS_H
@@ -31,62 +31,191 @@
 #include <string.h>
 #include "laravel-delete-reserved.h"
 #include "blocking-pop.h"
+#include "queue-type.h"
+#include "stats.h"
+#include "compression.h"
 
 typedef struct LaravelDeleteArguments {
     RedisModuleKey *reserved;
     RedisModuleString *strReserved;
     RedisModuleString *payload;
+    LaravelQueue *native;
+    RedisModuleKey *nativeKey;
+    RedisModuleString *strNativeQueue;
 } LaravelDeleteArguments;
 
-void releaseLaravelDeleteArguments(LaravelDeleteArguments *arguments)
+void releaseLaravelDeleteArguments(RedisModuleCtx *ctx, LaravelDeleteArguments *arguments)
 {
     if (arguments->reserved) {
         RedisModule_CloseKey(arguments->reserved);
         arguments->reserved = NULL;
     }
+    if (arguments->nativeKey) {
+        RedisModule_CloseKey(arguments->nativeKey);
+        arguments->nativeKey = NULL;
+    }
+    if (arguments->strNativeQueue) {
+        RedisModule_FreeString(ctx, arguments->strNativeQueue);
+        arguments->strNativeQueue = NULL;
+    }
 }
 
-LaravelDeleteArguments *getLaravelDeleteArguments(RedisModuleCtx *ctx, RedisModuleString **argv, int argc, LaravelDeleteArguments *arguments)
+LaravelDeleteArguments *getLaravelDeleteArguments(RedisModuleCtx *ctx, RedisModuleString **argv, int argc, int many,
+                                                  LaravelDeleteArguments *arguments)
 {
-    if (argc != 3) {
+    memset(arguments, 0, sizeof(LaravelDeleteArguments));
+
+    if (many ? argc < 3 : argc != 3) {
         RedisModule_WrongArity(ctx);
         return NULL;
     }
 
-    memset(arguments, 0, sizeof(LaravelDeleteArguments));
-
-    arguments->reserved = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_WRITE);
-    switch (RedisModule_KeyType(arguments->reserved)) {
-        case REDISMODULE_KEYTYPE_EMPTY:
-            break;
-        case REDISMODULE_KEYTYPE_ZSET:
-            break;
-        default:
-            RedisModule_ReplyWithError(ctx, "ERR WRONG KEY TYPE FOR KEYS[1] (zset expected for reserved queue)");
-            return NULL;
+    arguments->native = openNativeQueueOf(ctx, argv[1], ":reserved", 0, &arguments->nativeKey, &arguments->strNativeQueue);
+    if (! arguments->native) {
+        arguments->reserved = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_WRITE);
+        switch (RedisModule_KeyType(arguments->reserved)) {
+            case REDISMODULE_KEYTYPE_EMPTY:
+                break;
+            case REDISMODULE_KEYTYPE_ZSET:
+                break;
+            default:
+                RedisModule_ReplyWithError(ctx, "ERR WRONG KEY TYPE FOR KEYS[1] (zset expected for reserved queue)");
+                return NULL;
+        }
     }
     arguments->strReserved = argv[1];
 
-    arguments->payload = argv[2];
+    if (! many) {
+        arguments->payload = argv[2];
+    }
 
     return arguments;
 }
 
+/**
+ * The counters of the queue, held by its native queue.
+ */
+static QueueStats * reservedQueueStats(RedisModuleCtx *ctx, LaravelDeleteArguments *arguments)
+{
+    return getCachedQueueStats(ctx, arguments->native ? &arguments->native->stats : NULL, arguments->strReserved,
+                               ":reserved");
+}
+
+/**
+ * Remove jobs from the sorted set of reserved jobs with a replicated zrem, then the compressed form of the jobs that
+ * were not found, since large jobs may be reserved compressed.
+ *
+ * @return the number of removed jobs.
+ */
+static long long zremReservedJobs(RedisModuleCtx *ctx, RedisModuleString *strReserved, RedisModuleString **jobs, int n)
+{
+    RedisModuleCallReply *reply = RedisModule_Call(ctx, "zrem", "sv!", strReserved, jobs, (size_t) n);
+    long long deleted = RedisModule_CallReplyInteger(reply);
+    RedisModule_FreeCallReply(reply);
+    if (deleted == n) {
+        return deleted;
+    }
+    RedisModuleString **compressed = RedisModule_PoolAlloc(ctx, sizeof(RedisModuleString *) * n);
+    int m = 0;
+    for (int i = 0; i < n; ++i) {
+        if ((compressed[m] = compressedFormOf(ctx, jobs[i]))) {
+            m++;
+        }
+    }
+    if (m) {
+        reply = RedisModule_Call(ctx, "zrem", "sv!", strReserved, compressed, (size_t) m);
+        deleted += RedisModule_CallReplyInteger(reply);
+        RedisModule_FreeCallReply(reply);
+    }
+    for (int i = 0; i < m; ++i) {
+        RedisModule_FreeString(ctx, compressed[i]);
+    }
+    return deleted;
+}
+
+/**
+ * Delete a reserved job, without replying unless the arguments are invalid.
+ */
+int deleteReservedJob(RedisModuleCtx *ctx, RedisModuleString **argv, int argc)
+{
+    LaravelDeleteArguments arguments;
+    if (! getLaravelDeleteArguments(ctx, argv, argc, 0, &arguments)) {
+        releaseLaravelDeleteArguments(ctx, &arguments);
+        return REDISMODULE_ERR;
+    }
+
+    long long deleted;
+    if (arguments.native) {
+        // The payload may be the id of the job: the job itself is replicated, whatever the index of the replicas.
+        RedisModuleString *job = takeReservedNativeJob(ctx, &arguments.native->reserved, arguments.payload);
+        deleted = job != NULL;
+        if (deleted) {
+            RedisModule_Replicate(ctx, "laravel.native", "sccs", arguments.strNativeQueue, "ZREM", "RESERVED", job);
+            RedisModule_FreeString(ctx, job);
+            deleteNativeQueueIfEmpty(arguments.nativeKey, arguments.native);
+        }
+    } else {
+        deleted = zremReservedJobs(ctx, arguments.strReserved, &arguments.payload, 1);
+    }
+    if (deleted) {
+        reservedQueueStats(ctx, &arguments)->deleted += deleted;
+    }
+    // The timer is left as it is: if it fires early, it only re-arms for the next job.
+
+    releaseLaravelDeleteArguments(ctx, &arguments);
+    return REDISMODULE_OK;
+}
+
 int Laravel_Delete_Command(RedisModuleCtx *ctx, RedisModuleString **argv, int argc)
+{
+    if (deleteReservedJob(ctx, argv, argc) != REDISMODULE_OK) {
+        return REDISMODULE_ERR;
+    }
+    return RedisModule_ReplyWithSimpleString(ctx, "OK");
+}
+
+/**
+ * laravel.deletemany <queue>:reserved <job> [job ...]
+ *
+ * Delete all the jobs from the reserved queue with a single replicated zrem, and reply with the number of deleted jobs.
+ */
+int Laravel_DeleteMany_Command(RedisModuleCtx *ctx, RedisModuleString **argv, int argc)
 {
     LaravelDeleteArguments arguments;
-    if (! getLaravelDeleteArguments(ctx, argv, argc, &arguments)) {
-        releaseLaravelDeleteArguments(&arguments);
+    if (! getLaravelDeleteArguments(ctx, argv, argc, 1, &arguments)) {
+        releaseLaravelDeleteArguments(ctx, &arguments);
         return REDISMODULE_ERR;
     }
 
-    RedisModuleCallReply *deleted = RedisModule_Call(ctx, "zrem", "ss!", arguments.strReserved, arguments.payload);
-    RedisModule_FreeCallReply(deleted);
+    int n = argc - 2;
+    long long deleted = 0;
+    if (arguments.native) {
+        RedisModuleString **jobs = RedisModule_PoolAlloc(ctx, sizeof(RedisModuleString *) * n);
+        for (int i = 0; i < n; ++i) {
+            RedisModuleString *job = takeReservedNativeJob(ctx, &arguments.native->reserved, argv[2 + i]);
+            if (job) {
+                jobs[deleted++] = job;
+            }
+        }
+        if (deleted) {
+            RedisModule_Replicate(ctx, "laravel.native", "sccv", arguments.strNativeQueue, "ZREM", "RESERVED",
+                                  jobs, (size_t) deleted);
+            deleteNativeQueueIfEmpty(arguments.nativeKey, arguments.native);
+        }
+        for (long long i = 0; i < deleted; ++i) {
+            RedisModule_FreeString(ctx, jobs[i]);
+        }
+    } else {
+        deleted = zremReservedJobs(ctx, arguments.strReserved, argv + 2, n);
+    }
+    if (deleted) {
+        reservedQueueStats(ctx, &arguments)->deleted += deleted;
+    }
 
-    RedisModule_ReplyWithSimpleString(ctx, "OK");
-    updateTimerFor(ctx, arguments.strReserved, ":reserved");
+    // The timer is left as it is: if it fires early, it only re-arms for the next job.
+    RedisModule_ReplyWithLongLong(ctx, deleted);
 
-    releaseLaravelDeleteArguments(&arguments);
+    releaseLaravelDeleteArguments(ctx, &arguments);
     return REDISMODULE_OK;
 }
 
@@ -96,6 +225,10 @@ int Create_Laravel_Delete_Reserved_Command(RedisModuleCtx *ctx)
         == REDISMODULE_ERR) {
         return REDISMODULE_ERR;
     }
+    if (RedisModule_CreateCommand(ctx, "laravel.deletemany", Laravel_DeleteMany_Command, "write deny-oom fast", 1, 1, 1)
+        == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
 
     return REDISMODULE_OK;
 }
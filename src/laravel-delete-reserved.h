@@ -34,6 +34,16 @@
 
 #include "redismodule.h"
 
+/**
+ * Delete a reserved job, without replying unless the arguments are invalid.
+ *
+ * @param ctx
+ * @param argv the arguments of laravel.delete.
+ * @param argc
+ * @return REDISMODULE_OK, or REDISMODULE_ERR after replying with an error.
+ */
+int deleteReservedJob(RedisModuleCtx *ctx, RedisModuleString **argv, int argc);
+
 int Create_Laravel_Delete_Reserved_Command(RedisModuleCtx *ctx);
 
 
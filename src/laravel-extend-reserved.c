@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) 2018, Hamid Alaei Varnosfaderani
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+#include "laravel-extend-reserved.h"
+#include "blocking-pop.h"
+#include "queue-type.h"
+#include "stats.h"
+#include "compression.h"
+
+typedef struct LaravelExtendArguments {
+    RedisModuleKey *reserved;
+    RedisModuleString *strReserved;
+    RedisModuleString *payload;
+
+    /**
+     * The compressed form the payload is reserved as, to be freed.
+     */
+    RedisModuleString *compressed;
+    double availableAt;
+    RedisModuleString *strAvailableAt;
+    LaravelQueue *native;
+    RedisModuleKey *nativeKey;
+    RedisModuleString *strNativeQueue;
+} LaravelExtendArguments;
+
+void releaseLaravelExtendArguments(RedisModuleCtx *ctx, LaravelExtendArguments *arguments)
+{
+    if (arguments->reserved) {
+        RedisModule_CloseKey(arguments->reserved);
+        arguments->reserved = NULL;
+    }
+    if (arguments->nativeKey) {
+        RedisModule_CloseKey(arguments->nativeKey);
+        arguments->nativeKey = NULL;
+    }
+    if (arguments->strNativeQueue) {
+        RedisModule_FreeString(ctx, arguments->strNativeQueue);
+        arguments->strNativeQueue = NULL;
+    }
+    if (arguments->compressed) {
+        RedisModule_FreeString(ctx, arguments->compressed);
+        arguments->compressed = NULL;
+    }
+    if (arguments->strAvailableAt) {
+        RedisModule_FreeString(ctx, arguments->strAvailableAt);
+        arguments->strAvailableAt = NULL;
+    }
+}
+
+LaravelExtendArguments *getLaravelExtendArguments(RedisModuleCtx *ctx, RedisModuleString **argv, int argc,
+                                                  LaravelExtendArguments *arguments)
+{
+    memset(arguments, 0, sizeof(LaravelExtendArguments));
+
+    if (argc != 4) {
+        RedisModule_WrongArity(ctx);
+        return NULL;
+    }
+
+    long long extendMs;
+    if (RedisModule_StringToLongLong(argv[3], &extendMs) != REDISMODULE_OK) {
+        RedisModule_ReplyWithError(ctx, "ERR ARGV[2] IS NOT A VALID INTEGER (extension in milliseconds)");
+        return NULL;
+    }
+    arguments->availableAt = msdelayToTime(extendMs);
+    arguments->strAvailableAt = RedisModule_CreateStringPrintf(ctx, "%.17g", arguments->availableAt);
+
+    arguments->native = openNativeQueueOf(ctx, argv[1], ":reserved", 0, &arguments->nativeKey, &arguments->strNativeQueue);
+    if (! arguments->native) {
+        arguments->reserved = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_WRITE);
+        switch (RedisModule_KeyType(arguments->reserved)) {
+            case REDISMODULE_KEYTYPE_EMPTY:
+                break;
+            case REDISMODULE_KEYTYPE_ZSET:
+                break;
+            default:
+                RedisModule_ReplyWithError(ctx, "ERR WRONG KEY TYPE FOR KEYS[1] (zset expected for reserved queue)");
+                return NULL;
+        }
+    }
+    arguments->strReserved = argv[1];
+
+    arguments->payload = argv[2];
+
+    return arguments;
+}
+
+/**
+ * laravel.extend <queue>:reserved <job> <extend-ms>
+ *
+ * Move the deadline of a reserved job to extend-ms from now, and reply with 1, or with 0 if the job is not reserved
+ * anymore, e.g. because its reservation already expired.
+ */
+int Laravel_Extend_Command(RedisModuleCtx *ctx, RedisModuleString **argv, int argc)
+{
+    LaravelExtendArguments arguments;
+    if (! getLaravelExtendArguments(ctx, argv, argc, &arguments)) {
+        releaseLaravelExtendArguments(ctx, &arguments);
+        return REDISMODULE_ERR;
+    }
+
+    long long extended = 0;
+    if (arguments.native) {
+        // The payload may be the id of the job: the job itself is replicated.
+        JobHeapEntry *entry = findReservedNativeJob(ctx, &arguments.native->reserved, arguments.payload);
+        if (entry) {
+            JobHeap_Update(&arguments.native->reserved, entry, arguments.availableAt);
+            RedisModule_Replicate(ctx, "laravel.native", "sccss", arguments.strNativeQueue, "ZADD", "RESERVED",
+                                  arguments.strAvailableAt, entry->job);
+            extended = 1;
+        }
+    } else {
+        // ZADD only reports a changed score, so extending to the same deadline is told apart by membership.
+        RedisModuleString *member = findReservedMember(ctx, arguments.reserved, arguments.payload);
+        if (member) {
+            if (member != arguments.payload) {
+                arguments.compressed = member;
+            }
+            int flags = REDISMODULE_ZADD_XX;
+            RedisModule_ZsetAdd(arguments.reserved, arguments.availableAt, member, &flags);
+            RedisModule_Replicate(ctx, "zadd", "scss", arguments.strReserved, "XX", arguments.strAvailableAt, member);
+            extended = 1;
+        }
+    }
+
+    RedisModule_ReplyWithLongLong(ctx, extended);
+    if (extended) {
+        getCachedQueueStats(ctx, arguments.native ? &arguments.native->stats : NULL, arguments.strReserved,
+                            ":reserved")->extended++;
+        // A later deadline leaves the timer as it is: if it fires early, it only re-arms for the next job.
+        scheduleIfEarlier(ctx, arguments.reserved, arguments.strReserved, arguments.availableAt, ":reserved");
+    }
+
+    releaseLaravelExtendArguments(ctx, &arguments);
+    return REDISMODULE_OK;
+}
+
+int Create_Laravel_Extend_Reserved_Command(RedisModuleCtx *ctx)
+{
+    if (RedisModule_CreateCommand(ctx, "laravel.extend", Laravel_Extend_Command, "write deny-oom fast", 1, 1, 1)
+        == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
+
+    return REDISMODULE_OK;
+}
@@ -31,14 +31,23 @@
 #include "laravel-later.h"
 #include <string.h>
 #include "blocking-pop.h"
+#include "queue-type.h"
+#include "stats.h"
+#include "compression.h"
+#include "envelope.h"
 
 typedef struct LaravelLaterArguments {
     RedisModuleKey *queue;
     RedisModuleString *strQueue;
+    LaravelQueue *native;
+    RedisModuleKey *nativeKey;
+    RedisModuleString *strNativeQueue;
     long long delayMs;
     double availableAt;
     RedisModuleString *strAvailableAt;
     RedisModuleString *payload;
+    RedisModuleString *stored;
+    QueueStats *stats;
 } LaravelLaterArguments;
 
 void releaseLaravelLaterArguments(RedisModuleCtx *ctx, LaravelLaterArguments *arguments)
@@ -51,6 +60,18 @@ void releaseLaravelLaterArguments(RedisModuleCtx *ctx, LaravelLaterArguments *ar
         RedisModule_FreeString(ctx, arguments->strAvailableAt);
         arguments->strAvailableAt = NULL;
     }
+    if (arguments->nativeKey) {
+        RedisModule_CloseKey(arguments->nativeKey);
+        arguments->nativeKey = NULL;
+    }
+    if (arguments->strNativeQueue) {
+        RedisModule_FreeString(ctx, arguments->strNativeQueue);
+        arguments->strNativeQueue = NULL;
+    }
+    if (arguments->stored) {
+        RedisModule_FreeString(ctx, arguments->stored);
+        arguments->stored = NULL;
+    }
 }
 
 LaravelLaterArguments * getLaravelLaterArguments(RedisModuleCtx *ctx, RedisModuleString **argv, int argc, LaravelLaterArguments *arguments)
@@ -62,17 +83,25 @@ LaravelLaterArguments * getLaravelLaterArguments(RedisModuleCtx *ctx, RedisModul
 
     memset(arguments, 0, sizeof(LaravelLaterArguments));
 
-    arguments->queue = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_WRITE);
+    if (! isAcceptedJob(argv[3])) {
+        RedisModule_ReplyWithError(ctx, INVALID_JOB_ERROR);
+        return NULL;
+    }
+
     arguments->strQueue = argv[1];
-    switch (RedisModule_KeyType(arguments->queue)) {
-        case REDISMODULE_KEYTYPE_EMPTY:
-            break;
-        case REDISMODULE_KEYTYPE_ZSET:
-            break;
-        default:
-            releaseLaravelLaterArguments(ctx, arguments);
-            RedisModule_ReplyWithError(ctx, "ERR WRONG KEY TYPE FOR KEYS[1] (sorted set expected for delayed queue)");
-            return NULL;
+    arguments->native = openNativeQueueOf(ctx, argv[1], ":delayed", 1, &arguments->nativeKey, &arguments->strNativeQueue);
+    if (! arguments->native) {
+        arguments->queue = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_WRITE);
+        switch (RedisModule_KeyType(arguments->queue)) {
+            case REDISMODULE_KEYTYPE_EMPTY:
+                break;
+            case REDISMODULE_KEYTYPE_ZSET:
+                break;
+            default:
+                releaseLaravelLaterArguments(ctx, arguments);
+                RedisModule_ReplyWithError(ctx, "ERR WRONG KEY TYPE FOR KEYS[1] (sorted set expected for delayed queue)");
+                return NULL;
+        }
     }
 
     if (RedisModule_StringToLongLong(argv[2], &arguments->delayMs) != REDISMODULE_OK) {
@@ -81,9 +110,11 @@ LaravelLaterArguments * getLaravelLaterArguments(RedisModuleCtx *ctx, RedisModul
         return NULL;
     }
     arguments->availableAt = msdelayToTime(arguments->delayMs);
-    arguments->strAvailableAt = RedisModule_CreateStringPrintf(ctx, "%f", arguments->availableAt);
+    arguments->strAvailableAt = RedisModule_CreateStringPrintf(ctx, "%.17g", arguments->availableAt);
 
-    arguments->payload = argv[3];
+    arguments->stats = getCachedQueueStats(ctx, arguments->native ? &arguments->native->stats : NULL, argv[1], ":delayed");
+    arguments->stored = storedJobOf(ctx, argv[3], arguments->stats);
+    arguments->payload = arguments->stored ? arguments->stored : argv[3];
 
     return arguments;
 }
@@ -96,12 +127,21 @@ int Laravel_Later_Command(RedisModuleCtx *ctx, RedisModuleString **argv, int arg
     }
 
     int flags = 0;
-    if (RedisModule_ZsetAdd(arguments.queue, arguments.availableAt, arguments.payload, &flags) != REDISMODULE_OK) {
+    if (arguments.native) {
+        RedisModule_RetainString(NULL, arguments.payload);
+        int added = JobHeap_Add(&arguments.native->delayed, arguments.availableAt, arguments.payload);
+        RedisModule_Replicate(ctx, "laravel.native", "sccss", arguments.strNativeQueue, "ZADD", "DELAYED",
+                              arguments.strAvailableAt, arguments.payload);
+        RedisModule_ReplyWithLongLong(ctx, added);
+        arguments.stats->later++;
+        scheduleIfEarlier(ctx, arguments.queue, arguments.strQueue, arguments.availableAt, ":delayed");
+    } else if (RedisModule_ZsetAdd(arguments.queue, arguments.availableAt, arguments.payload, &flags) != REDISMODULE_OK) {
         RedisModule_ReplyWithError(ctx, "ERR Unknown error in zadd");
     } else {
         RedisModule_Replicate(ctx, "zadd", "sss", arguments.strQueue, arguments.strAvailableAt, arguments.payload);
         RedisModule_ReplyWithLongLong(ctx, (flags & REDISMODULE_ZADD_ADDED) ? 1 : 0);
-        updateTimerFor(ctx, arguments.strQueue, ":delayed");
+        arguments.stats->later++;
+        scheduleIfEarlier(ctx, arguments.queue, arguments.strQueue, arguments.availableAt, ":delayed");
     }
 
     releaseLaravelLaterArguments(ctx, &arguments);
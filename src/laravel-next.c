@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2018, Hamid Alaei Varnosfaderani
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <strings.h>
+#include "laravel-next.h"
+#include "laravel-pop.h"
+#include "laravel-delete-reserved.h"
+#include "laravel-release-reserved.h"
+
+/**
+ * Number of the arguments of an acknowledgement, from DELETE or RELEASE to the last one.
+ *
+ * @return the number of arguments, or 0 if the acknowledgement is unknown.
+ */
+static int ackArgumentsOf(RedisModuleString *ack)
+{
+    const char *str = RedisModule_StringPtrLen(ack, NULL);
+    if (! strcasecmp(str, "DELETE")) {
+        return 3;
+    }
+    if (! strcasecmp(str, "RELEASE")) {
+        return 5;
+    }
+    return 0;
+}
+
+/**
+ * laravel.next DELETE <queue>:reserved <job> <queue> <delayed> <reserved> [...] <retry-after-ms> <block-for-ms>
+ * laravel.next RELEASE <queue>:delayed <queue>:reserved <job> <delay-ms> <queue> <delayed> <reserved> [...]
+ *              <retry-after-ms> <block-for-ms>
+ *
+ * Delete or release the previous job of a worker, then pop the next one exactly like laravel.pop.
+ * The acknowledgement is kept even if the pop replies with an error.
+ */
+int Laravel_Next_Command(RedisModuleCtx *ctx, RedisModuleString **argv, int argc)
+{
+    int acked = argc > 1 ? ackArgumentsOf(argv[1]) : 0;
+    // The pop arguments are at least one queue and the two options, with the last acknowledgement argument as argv[0].
+    int popArgc = argc - acked;
+    if (argc < 2 || (acked && (popArgc < 6 || (popArgc - 3) % 3))) {
+        return RedisModule_WrongArity(ctx);
+    }
+    if (! acked) {
+        return RedisModule_ReplyWithError(ctx, "ERR SYNTAX ERROR (DELETE or RELEASE expected)");
+    }
+
+    if (RedisModule_IsKeysPositionRequest(ctx)) {
+        // The reserved queue, or the delayed and the reserved queues, before the job and the delay.
+        for (int i = 2; i < (acked == 3 ? 3 : 4); ++i) {
+            RedisModule_KeyAtPos(ctx, i);
+        }
+        for (int i = acked + 1; i < argc - 2; ++i) {
+            RedisModule_KeyAtPos(ctx, i);
+        }
+        return REDISMODULE_OK;
+    }
+
+    int status = acked == 3 ? deleteReservedJob(ctx, argv + 1, acked) : releaseReservedJob(ctx, argv + 1, acked);
+    if (status != REDISMODULE_OK) {
+        return REDISMODULE_OK;
+    }
+    return popJobs(ctx, argv + acked, popArgc, 0);
+}
+
+int Create_Laravel_Next_Command(RedisModuleCtx *ctx)
+{
+    if (RedisModule_CreateCommand(ctx, "laravel.next", Laravel_Next_Command, "write deny-oom fast getkeys-api", 0, 0, 0)
+        == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
+
+    return REDISMODULE_OK;
+}
@@ -30,15 +30,27 @@
 
 #include "laravel-pop.h"
 
+#include <stdio.h>
 #include <string.h>
 
 #include "../vendor/cJSON.h"
 #include "blocking-pop.h"
+#include "job-attempts.h"
+#include "stats.h"
+#include "latency.h"
+#include "config.h"
+#include "envelope.h"
+#include "compression.h"
+#include "thread-pool.h"
 
-int openLaravelPopKeys(RedisModuleCtx *ctx, LaravelPopArguments *arguments)
+int openLaravelPopQueueKeys(RedisModuleCtx *ctx, LaravelPopArguments *arguments)
 {
     if (! arguments->list) {
         arguments->list = RedisModule_OpenKey(ctx, arguments->strList, REDISMODULE_WRITE);
+        arguments->native = getNativeQueue(ctx, arguments->list, arguments->strList, 0);
+        if (arguments->native) {
+            return REDISMODULE_OK;
+        }
         int type = RedisModule_KeyType(arguments->list);
         if (type != REDISMODULE_KEYTYPE_EMPTY && type != REDISMODULE_KEYTYPE_LIST) {
             return REDISMODULE_ERR;
@@ -61,11 +73,25 @@ int openLaravelPopKeys(RedisModuleCtx *ctx, LaravelPopArguments *arguments)
     return REDISMODULE_OK;
 }
 
-void closeLaravelPopKeys(LaravelPopArguments *arguments)
+/**
+ * Open the keys of all the queues.
+ */
+int openLaravelPopKeys(RedisModuleCtx *ctx, LaravelPopArguments *arguments)
+{
+    for (; arguments; arguments = arguments->next) {
+        if (openLaravelPopQueueKeys(ctx, arguments) != REDISMODULE_OK) {
+            return REDISMODULE_ERR;
+        }
+    }
+    return REDISMODULE_OK;
+}
+
+void closeLaravelPopQueueKeys(LaravelPopArguments *arguments)
 {
     if (arguments->list) {
         RedisModule_CloseKey(arguments->list);
         arguments->list = NULL;
+        arguments->native = NULL;
     }
     if (arguments->delayed) {
         RedisModule_CloseKey(arguments->delayed);
@@ -77,94 +103,217 @@ void closeLaravelPopKeys(LaravelPopArguments *arguments)
     }
 }
 
-void releaseLaravelPopArguments(RedisModuleCtx *ctx, LaravelPopArguments *arguments)
+/**
+ * Close the keys of all the queues.
+ */
+void closeLaravelPopKeys(LaravelPopArguments *arguments)
 {
-    if (! arguments) {
-        return;
+    for (; arguments; arguments = arguments->next) {
+        closeLaravelPopQueueKeys(arguments);
     }
-    closeLaravelPopKeys(arguments);
-
-    RedisModule_Free(arguments);
 }
 
-void prepareArgumentsForBlockingPop(RedisModuleCtx *ctx, LaravelPopArguments *arguments)
+#define LARAVEL_MAX_SPARE_POP_ARGUMENTS 1024
+
+/**
+ * Released arguments, linked through their waiting nodes, to be reused without allocation.
+ */
+DLList spareArguments;
+
+LaravelPopArguments * allocLaravelPopArguments()
 {
-    arguments->strList = RedisModule_CreateStringFromString(ctx, arguments->strList);
-    arguments->strDelayed = RedisModule_CreateStringFromString(ctx, arguments->strDelayed);
-    arguments->strReserved = RedisModule_CreateStringFromString(ctx, arguments->strReserved);
+    LaravelPopArguments *arguments;
+    if (spareArguments.front) {
+        arguments = spareArguments.front->data;
+        DLList_Delete(&spareArguments, spareArguments.front);
+    } else {
+        arguments = RedisModule_Alloc(sizeof(LaravelPopArguments));
+    }
+    memset(arguments, 0, sizeof(LaravelPopArguments));
+    return arguments;
 }
 
-LaravelPopArguments * getLaravelPopArguments(RedisModuleCtx *ctx, RedisModuleString **argv, int argc)
+/**
+ * Release the arguments of all the queues.
+ */
+void releaseLaravelPopArguments(RedisModuleCtx *ctx, LaravelPopArguments *arguments)
 {
-    if (argc != 6) {
-        RedisModule_WrongArity(ctx);
-        return NULL;
+    while (arguments) {
+        LaravelPopArguments *next = arguments->next;
+        closeLaravelPopQueueKeys(arguments);
+
+        if (arguments->ownsNames) {
+            RedisModule_FreeString(NULL, arguments->strList);
+            RedisModule_FreeString(NULL, arguments->strDelayed);
+            RedisModule_FreeString(NULL, arguments->strReserved);
+        }
+        if (spareArguments.size < LARAVEL_MAX_SPARE_POP_ARGUMENTS) {
+            arguments->waitingNode.data = arguments;
+            DLList_Push_Front(&spareArguments, &arguments->waitingNode);
+        } else {
+            RedisModule_Free(arguments);
+        }
+        arguments = next;
     }
-    LaravelPopArguments *arguments = RedisModule_Alloc(sizeof(LaravelPopArguments));
-    memset(arguments, 0, sizeof(LaravelPopArguments));
+}
 
-    arguments->list = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_WRITE);
-    arguments->strList = argv[1];
+/**
+ * Open and validate the keys of a queue.
+ *
+ * @param key index of the queue in argv.
+ * @return REDISMODULE_OK, or REDISMODULE_ERR after replying with an error.
+ */
+int getLaravelPopQueue(RedisModuleCtx *ctx, RedisModuleString **argv, int key, LaravelPopArguments *arguments)
+{
+    char error[128];
+    arguments->list = RedisModule_OpenKey(ctx, argv[key], REDISMODULE_WRITE);
+    arguments->strList = argv[key];
+    arguments->strDelayed = argv[key + 1];
+    arguments->strReserved = argv[key + 2];
+    arguments->native = getNativeQueue(ctx, arguments->list, arguments->strList, 0);
+    // A native queue holds the delayed and reserved jobs itself.
+    if (arguments->native) {
+        return REDISMODULE_OK;
+    }
     switch (RedisModule_KeyType(arguments->list)) {
         case REDISMODULE_KEYTYPE_EMPTY:
             break;
         case REDISMODULE_KEYTYPE_LIST:
             break;
         default:
-            releaseLaravelPopArguments(ctx, arguments);
-            RedisModule_ReplyWithError(ctx, "ERR WRONG KEY TYPE FOR KEYS[1] (list expected for main queue)");
-            return NULL;
+            snprintf(error, sizeof(error), "ERR WRONG KEY TYPE FOR KEYS[%d] (list expected for main queue)", key);
+            RedisModule_ReplyWithError(ctx, error);
+            return REDISMODULE_ERR;
     }
-    arguments->delayed = RedisModule_OpenKey(ctx, argv[2], REDISMODULE_WRITE);
-    arguments->strDelayed = argv[2];
+    arguments->delayed = RedisModule_OpenKey(ctx, argv[key + 1], REDISMODULE_WRITE);
     switch (RedisModule_KeyType(arguments->delayed)) {
         case REDISMODULE_KEYTYPE_EMPTY:
             break;
         case REDISMODULE_KEYTYPE_ZSET:
             break;
         default:
-            releaseLaravelPopArguments(ctx, arguments);
-            RedisModule_ReplyWithError(ctx, "ERR WRONG KEY TYPE FOR KEYS[2] (zset expected for delayed queue)");
-            return NULL;
+            snprintf(error, sizeof(error), "ERR WRONG KEY TYPE FOR KEYS[%d] (zset expected for delayed queue)", key + 1);
+            RedisModule_ReplyWithError(ctx, error);
+            return REDISMODULE_ERR;
     }
-    arguments->reserved = RedisModule_OpenKey(ctx, argv[3], REDISMODULE_WRITE);
-    arguments->strReserved = argv[3];
+    arguments->reserved = RedisModule_OpenKey(ctx, argv[key + 2], REDISMODULE_WRITE);
     switch (RedisModule_KeyType(arguments->reserved)) {
         case REDISMODULE_KEYTYPE_EMPTY:
             break;
         case REDISMODULE_KEYTYPE_ZSET:
             break;
         default:
-            releaseLaravelPopArguments(ctx, arguments);
-            RedisModule_ReplyWithError(ctx, "ERR WRONG KEY TYPE FOR KEYS[3] (zset expected for reserved queue)");
-            return NULL;
+            snprintf(error, sizeof(error), "ERR WRONG KEY TYPE FOR KEYS[%d] (zset expected for reserved queue)", key + 2);
+            RedisModule_ReplyWithError(ctx, error);
+            return REDISMODULE_ERR;
     }
-    if (RedisModule_StringToLongLong(argv[4], &arguments->retryAfterMs) != REDISMODULE_OK) {
-        releaseLaravelPopArguments(ctx, arguments);
+    return REDISMODULE_OK;
+}
+
+/**
+ * Parse [queue delayed reserved]... retry-after block-for [count].
+ *
+ * @return the arguments of the first queue, linked to the next queues in priority order.
+ */
+LaravelPopArguments * getLaravelPopArguments(RedisModuleCtx *ctx, RedisModuleString **argv, int argc, int many)
+{
+    int options = many ? 3 : 2;
+    if (argc < 4 + options || (argc - 1 - options) % 3) {
+        RedisModule_WrongArity(ctx);
+        return NULL;
+    }
+    int queues = (argc - 1 - options) / 3;
+    RedisModuleString **option = argv + 1 + 3 * queues;
+    long long retryAfterMs, blockFor, count = 1;
+    if (RedisModule_StringToLongLong(option[0], &retryAfterMs) != REDISMODULE_OK) {
         RedisModule_ReplyWithError(ctx, "ERR ARGV[1] IS NOT A VALID INTEGER (retry after in milliseconds)");
+        return NULL;
     }
-
-    if (RedisModule_StringToLongLong(argv[5], &arguments->blockFor) != REDISMODULE_OK) {
-        releaseLaravelPopArguments(ctx, arguments);
+    if (RedisModule_StringToLongLong(option[1], &blockFor) != REDISMODULE_OK) {
         RedisModule_ReplyWithError(ctx, "ERR ARGV[2] IS NOT A VALID INTEGER (blockFor in milliseconds)");
         return NULL;
     }
-    arguments->jobWasAssigned = 0;
-    arguments->jobWasDelivered = 0;
-    return arguments;
+    if (many && (RedisModule_StringToLongLong(option[2], &count) != REDISMODULE_OK || count < 1)) {
+        RedisModule_ReplyWithError(ctx, "ERR ARGV[3] IS NOT A VALID POSITIVE INTEGER (count)");
+        return NULL;
+    }
+    for (int i = 1; i < queues; ++i) {
+        for (int j = 0; j < i; ++j) {
+            if (RedisModule_StringCompare(argv[1 + 3 * i], argv[1 + 3 * j]) == 0) {
+                RedisModule_ReplyWithError(ctx, "ERR THE SAME QUEUE IS GIVEN MORE THAN ONCE");
+                return NULL;
+            }
+        }
+    }
+
+    LaravelPopArguments *first = NULL, *last = NULL;
+    for (int i = 0; i < queues; ++i) {
+        LaravelPopArguments *arguments = allocLaravelPopArguments();
+        arguments->first = first ? first : arguments;
+        if (last) {
+            last->next = arguments;
+        } else {
+            first = arguments;
+        }
+        last = arguments;
+        arguments->retryAfterMs = retryAfterMs;
+        arguments->blockFor = blockFor;
+        arguments->count = count;
+        arguments->many = many;
+        if (getLaravelPopQueue(ctx, argv, 1 + 3 * i, arguments) != REDISMODULE_OK) {
+            releaseLaravelPopArguments(ctx, first);
+            return NULL;
+        }
+    }
+    return first;
+}
+
+/**
+ * The counters of a queue that has jobs, held by its native queue or looked up once per command.
+ */
+static QueueStats * queueStatsOf(RedisModuleCtx *ctx, LaravelPopArguments *arguments)
+{
+    return getCachedQueueStats(ctx, arguments->native ? &arguments->native->stats : &arguments->stats,
+                               arguments->strList, "");
+}
+
+/**
+ * The counters of a queue that may not exist, or NULL if it has none.
+ */
+static QueueStats * existingQueueStatsOf(RedisModuleCtx *ctx, LaravelPopArguments *arguments)
+{
+    if (! arguments->native) {
+        return findCachedQueueStats(ctx, &arguments->stats, arguments->strList);
+    }
+    return queueStatsOf(ctx, arguments);
 }
 
 int reply_blocking_pop(RedisModuleCtx *ctx, RedisModuleString **argv, int argc);
 
 int timeout_blocking_pop(RedisModuleCtx *ctx, RedisModuleString **argv, int argc)
 {
-    removeFromWaitingList(RedisModule_GetSelectedDb(ctx), RedisModule_GetBlockedClientHandle(ctx));
+    // The private data is not set before unblock, so the arguments are freed here.
+    LaravelPopArguments *arguments = removeFromWaitingList(RedisModule_GetSelectedDb(ctx),
+                                                           RedisModule_GetBlockedClientHandle(ctx));
+    if (arguments) {
+        for (LaravelPopArguments *queue = arguments; queue; queue = queue->next) {
+            QueueStats *stats = existingQueueStatsOf(ctx, queue);
+            if (! stats) {
+                continue;
+            }
+            if (queue == arguments) {
+                Latency_Blocked(stats, ustime() - arguments->blockedAt);
+            }
+            stats->timeouts++;
+        }
+        releaseLaravelPopArguments(ctx, arguments);
+    }
     return RedisModule_ReplyWithNull(ctx);
 }
 
 void disconnect_blocking_pop(RedisModuleCtx *ctx, RedisModuleBlockedClient *bc)
 {
-    removeFromWaitingList(RedisModule_GetSelectedDb(ctx), bc);
+    releaseLaravelPopArguments(ctx, removeFromWaitingList(RedisModule_GetSelectedDb(ctx), bc));
 }
 
 void free_blocking_pop_data(RedisModuleCtx *ctx, void *data)
@@ -172,129 +321,653 @@ void free_blocking_pop_data(RedisModuleCtx *ctx, void *data)
     LaravelPopArguments *arguments = data;
     if (arguments->jobWasAssigned && ! arguments->jobWasDelivered) {
         // unblock another client because this one timed-out/disconnected after job was assigned but before delivered.
-        jobsWasPushed(RedisModule_GetSelectedDb(ctx), arguments->strList, 1);
+        jobsWasPushed(RedisModule_GetSelectedDb(ctx), arguments->wokenBy->strList, arguments->count);
     }
-    RedisModule_FreeString(ctx, arguments->strList);
-    RedisModule_FreeString(ctx, arguments->strDelayed);
-    RedisModule_FreeString(ctx, arguments->strReserved);
     releaseLaravelPopArguments(ctx, data);
 }
 
-RedisModuleString * reserveJob(RedisModuleCtx *ctx, LaravelPopArguments *arguments, RedisModuleString *job)
+/**
+ * Increment attempts of a job by parsing and printing the whole json.
+ * It needs no context, so it can run on any thread.
+ *
+ * @return the new job to be freed by cJSON_free, or NULL if the job is invalid.
+ */
+static char * incrementAttemptsWithParserToBuffer(const char *str, size_t len, size_t *newLen, long long *newAttempts)
 {
-    size_t len;
-    const char *str = RedisModule_StringPtrLen(job, &len);
     // Validate string does not have 0
-    for (size_t i = 0; i < len; ++i) {
-        if (! str[i]) {
-            return NULL;
-        }
+    if (memchr(str, 0, len)) {
+        return NULL;
     }
     // Convert the string to zero-terminated c-string
-    char *cstr = RedisModule_PoolAlloc(ctx, len + 1);
+    char *cstr = cJSON_malloc(len + 1);
     memcpy(cstr, str, len);
     cstr[len] = 0;
     // Parse the json
-    cJSON *json = cJSON_Parse(cstr); // Pool Memory Management
+    cJSON *json = cJSON_Parse(cstr);
+    cJSON_free(cstr);
     if (json == NULL) {
         return NULL;
     }
+    char *rJob = NULL;
     // Validate json is object
     if (cJSON_IsObject(json)) {
         cJSON * attempts = cJSON_GetObjectItemCaseSensitive(json, "attempts");
         // Validate json has attempts
         if (cJSON_IsNumber(attempts)) {
             // Increment attempts
-            cJSON *newAttempts = cJSON_CreateNumber(attempts->valueint + 1); // Pool Memory Management
-            cJSON_ReplaceItemInObjectCaseSensitive(json, "attempts", newAttempts);
+            *newAttempts = (long long) attempts->valueint + 1;
+            cJSON_ReplaceItemInObjectCaseSensitive(json, "attempts", cJSON_CreateNumber((double) *newAttempts));
             // Print json
-            char * rJob = cJSON_PrintUnformatted(json); // Pool Memory Management
-            RedisModuleString *rStrJob = RedisModule_CreateString(ctx, rJob, strlen(rJob));
-            double availableAt = msdelayToTime(arguments->retryAfterMs);
-            RedisModule_ZsetAdd(arguments->reserved, availableAt, rStrJob, NULL);
-            RedisModuleString *strAvailableAt = RedisModule_CreateStringPrintf(ctx, "%f", availableAt);
-            RedisModule_Replicate(ctx, "zadd", "sss", arguments->strReserved, strAvailableAt, rStrJob);
-            RedisModule_FreeString(ctx, strAvailableAt);
-            return rStrJob;
+            rJob = cJSON_PrintUnformatted(json);
+            *newLen = strlen(rJob);
         }
     }
-    return NULL;
+    cJSON_Delete(json);
+    return rJob;
 }
 
+/**
+ * Increment attempts of a job by parsing and printing the whole json.
+ */
+RedisModuleString * incrementAttemptsWithParser(RedisModuleCtx *ctx, const char *str, size_t len, long long *newAttempts)
+{
+    size_t newLen;
+    char *rJob = incrementAttemptsWithParserToBuffer(str, len, &newLen, newAttempts);
+    if (! rJob) {
+        return NULL;
+    }
+    RedisModuleString *rStrJob = RedisModule_CreateString(ctx, rJob, newLen);
+    cJSON_free(rJob);
+    return rStrJob;
+}
 
-#define JOB_RETRIEVAL_DONE 0
-#define JOB_RETRIEVAL_NEEDS_BLOCKING 1
+/**
+ * Increment attempts of a job.
+ * The header of an envelope is rewritten in place. The json is scanned once and the new attempts is spliced in,
+ * unless the scanner can't handle the job.
+ *
+ * @param newAttempts set to the incremented attempts.
+ */
+RedisModuleString * incrementAttempts(RedisModuleCtx *ctx, RedisModuleString *job, long long *newAttempts)
+{
+    size_t len;
+    const char *str = RedisModule_StringPtrLen(job, &len);
+    if (isJobEnvelope(str, len)) {
+        char *buffer = RedisModule_PoolAlloc(ctx, len);
+        return RedisModule_CreateString(ctx, buffer, writeIncrementedEnvelopeAttempts(str, len, buffer, newAttempts));
+    }
+    JobAttempts attempts;
+    if (findJobAttempts(str, len, &attempts)) {
+        char *buffer = RedisModule_PoolAlloc(ctx, len + 1);
+        *newAttempts = attempts.value + 1;
+        return RedisModule_CreateString(ctx, buffer, writeIncrementedJobAttempts(str, len, &attempts, buffer));
+    }
+    return incrementAttemptsWithParser(ctx, str, len, newAttempts);
+}
+
+/**
+ * Increment attempts of a job without a context, to run on an offload thread.
+ *
+ * @return the new job to be freed by cJSON_free, or NULL if the job is invalid.
+ */
+static char * incrementAttemptsToBuffer(RedisModuleString *job, size_t *newLen, long long *newAttempts)
+{
+    size_t len;
+    const char *str = RedisModule_StringPtrLen(job, &len);
+    if (isJobEnvelope(str, len)) {
+        char *buffer = cJSON_malloc(len);
+        *newLen = writeIncrementedEnvelopeAttempts(str, len, buffer, newAttempts);
+        return buffer;
+    }
+    JobAttempts attempts;
+    if (findJobAttempts(str, len, &attempts)) {
+        char *buffer = cJSON_malloc(len + 1);
+        *newAttempts = attempts.value + 1;
+        *newLen = writeIncrementedJobAttempts(str, len, &attempts, buffer);
+        return buffer;
+    }
+    return incrementAttemptsWithParserToBuffer(str, len, newLen, newAttempts);
+}
+
+static void addReservedJob(LaravelPopArguments *arguments, RedisModuleString *reservedJob, double availableAt)
+{
+    if (arguments->native) {
+        RedisModule_RetainString(NULL, reservedJob);
+        JobHeap_Add(&arguments->native->reserved, availableAt, reservedJob);
+    } else {
+        RedisModule_ZsetAdd(arguments->reserved, availableAt, reservedJob, NULL);
+    }
+}
+
+/**
+ * Whether reserved jobs are stored compressed: the index of reserve-by-id reads the id from the job as stored.
+ */
+static int compressesReservedJobs(LaravelPopArguments *arguments)
+{
+    return ! arguments->native || ! arguments->native->reserved.byId;
+}
+
+/**
+ * @param newAttempts set to the attempts of the reserved job.
+ * @param storedJob set to the compressed reserved job to be freed, or to NULL if it is stored as is. May be NULL.
+ */
+RedisModuleString * reserveJob(RedisModuleCtx *ctx, LaravelPopArguments *arguments, RedisModuleString *job, double availableAt,
+                               long long *newAttempts, RedisModuleString **storedJob)
+{
+    RedisModuleString *rStrJob = incrementAttempts(ctx, job, newAttempts);
+    if (! rStrJob) {
+        return NULL;
+    }
+    RedisModuleString *compressed = compressesReservedJobs(arguments) ? compressJob(ctx, rStrJob, NULL) : NULL;
+    addReservedJob(arguments, compressed ? compressed : rStrJob, availableAt);
+    if (storedJob) {
+        *storedJob = compressed;
+    } else if (compressed) {
+        RedisModule_FreeString(ctx, compressed);
+    }
+    return rStrJob;
+}
 
-int retrieveNextJob(RedisModuleCtx *ctx, LaravelPopArguments *arguments)
+RedisModuleString * popJob(LaravelPopArguments *arguments)
 {
-    RedisModuleString *job = RedisModule_ListPop(arguments->list, REDISMODULE_LIST_HEAD);
-    if (job) {
+    if (arguments->native) {
+        return JobDeque_Pop_Front(&arguments->native->ready);
+    }
+    return RedisModule_ListPop(arguments->list, REDISMODULE_LIST_HEAD);
+}
+
+
+static void replicatePop(RedisModuleCtx *ctx, LaravelPopArguments *arguments, long long popped)
+{
+    if (arguments->native) {
+        RedisModule_Replicate(ctx, "laravel.native", "scl", arguments->strList, "LPOP", popped);
+    } else if (popped == 1) {
         RedisModule_Replicate(ctx, "lpop", "s", arguments->strList);
-        RedisModuleString *reservedJob = reserveJob(ctx, arguments, job);
+    } else {
+        RedisModule_Replicate(ctx, "ltrim", "sll", arguments->strList, popped, -1ll);
+    }
+}
+
+/**
+ * @param zadd [score, reserved job] pairs.
+ */
+static void replicateReserve(RedisModuleCtx *ctx, LaravelPopArguments *arguments, RedisModuleString **zadd,
+                             long long reserved)
+{
+    if (! reserved) {
+        return;
+    }
+    if (arguments->native) {
+        RedisModule_Replicate(ctx, "laravel.native", "sccv", arguments->strList, "ZADD", "RESERVED",
+                              zadd, (size_t) (2 * reserved));
+    } else {
+        RedisModule_Replicate(ctx, "zadd", "sv", arguments->strReserved, zadd, (size_t) (2 * reserved));
+    }
+}
+
+/**
+ * Reply with [job, reserved job] pairs, or with [reserved job, attempts] pairs if the job-envelope option is on.
+ *
+ * @param n number of popped jobs.
+ * @param reserved number of the valid jobs.
+ * @param reservedJobs the reserved job of each popped job, or NULL if it is invalid.
+ */
+static void replyWithReservedJobs(RedisModuleCtx *ctx, int many, long long n, long long reserved,
+                                  RedisModuleString **jobs, RedisModuleString **reservedJobs, long long *attempts)
+{
+    if (! reserved) {
+        RedisModule_ReplyWithError(ctx, "ERR AN INVALID JOB DROPPED FROM THE QUEUE");
+        return;
+    }
+    RedisModule_ReplyWithArray(ctx, many ? 2 * reserved : 2);
+    for (long long i = 0; i < n; ++i) {
+        if (! reservedJobs[i]) {
+            continue;
+        }
+        if (laravelQueueConfig.jobEnvelope) {
+            RedisModule_ReplyWithString(ctx, reservedJobs[i]);
+            RedisModule_ReplyWithLongLong(ctx, attempts[i]);
+        } else {
+            RedisModule_ReplyWithString(ctx, jobs[i]);
+            RedisModule_ReplyWithString(ctx, reservedJobs[i]);
+        }
+    }
+}
+
+/**
+ * Jobs popped by a command, whose attempts are rewritten on an offload thread.
+ * The popped jobs are reserved as they are until the rewritten jobs replace them.
+ */
+typedef struct OffloadedPop
+{
+    ThreadPoolTask task;
+    RedisModuleBlockedClient *bc;
+    int db;
+    int many;
+    RedisModuleString *strList;
+    RedisModuleString *strReserved;
+    QueueStatsCache stats;
+    int compress;
+    long long popped;
+    RedisModuleString **jobs;
+
+    /**
+     * The reserved job of each popped job, or NULL if it is invalid.
+     */
+    RedisModuleString **reservedJobs;
+    long long *attempts;
+    long long reserved;
+} OffloadedPop;
+
+/**
+ * Remove a popped job from the reserved jobs, unless it is not reserved anymore.
+ *
+ * @param score set to the deadline of the job.
+ * @return 1 if removed.
+ */
+static int takeReservedJob(LaravelPopArguments *arguments, RedisModuleString *job, double *score)
+{
+    if (arguments->native) {
+        JobHeapEntry *entry = JobHeap_Find(&arguments->native->reserved, job);
+        if (! entry) {
+            return 0;
+        }
+        *score = entry->score;
+        RedisModule_FreeString(NULL, JobHeap_Take(&arguments->native->reserved, job));
+        return 1;
+    }
+    if (! arguments->reserved || RedisModule_ZsetScore(arguments->reserved, job, score) != REDISMODULE_OK) {
+        return 0;
+    }
+    RedisModule_ZsetRem(arguments->reserved, job, NULL);
+    return 1;
+}
+
+/**
+ * Rewrite the jobs off the main thread, then replace the reserved popped jobs under the lock of the server.
+ * A popped job that is not reserved anymore, e.g. because it was migrated back after retry-after, is not replaced.
+ */
+static void runOffloadedPop(ThreadPoolTask *task)
+{
+    OffloadedPop *pop = (OffloadedPop *) task;
+    char **buffers = RedisModule_Alloc(sizeof(char *) * pop->popped);
+    size_t *lens = RedisModule_Alloc(sizeof(size_t) * pop->popped);
+    char **compressed = RedisModule_Calloc(pop->popped, sizeof(char *));
+    size_t *compressedLens = RedisModule_Calloc(pop->popped, sizeof(size_t));
+    for (long long i = 0; i < pop->popped; ++i) {
+        buffers[i] = incrementAttemptsToBuffer(pop->jobs[i], &lens[i], &pop->attempts[i]);
+        if (buffers[i] && pop->compress && laravelQueueConfig.compressSize) {
+            compressed[i] = RedisModule_Alloc(compressedJobBound(lens[i]));
+            compressedLens[i] = compressJobToBuffer(buffers[i], lens[i], compressed[i]);
+        }
+    }
+
+    RedisModuleCtx *ctx = RedisModule_GetThreadSafeContext(pop->bc);
+    RedisModule_ThreadSafeContextLock(ctx);
+    RedisModule_SelectDb(ctx, pop->db);
+    LaravelPopArguments arguments;
+    memset(&arguments, 0, sizeof(LaravelPopArguments));
+    arguments.strList = pop->strList;
+    arguments.strReserved = pop->strReserved;
+    arguments.list = RedisModule_OpenKey(ctx, pop->strList, REDISMODULE_WRITE);
+    arguments.native = getNativeQueue(ctx, arguments.list, pop->strList, 0);
+    if (! arguments.native) {
+        arguments.reserved = RedisModule_OpenKey(ctx, pop->strReserved, REDISMODULE_WRITE);
+        if (RedisModule_KeyType(arguments.reserved) != REDISMODULE_KEYTYPE_ZSET) {
+            RedisModule_CloseKey(arguments.reserved);
+            arguments.reserved = NULL;
+        }
+    }
+    // The removed popped jobs, and the [score, reserved job] pairs that replace them.
+    RedisModuleString **removed = RedisModule_Alloc(sizeof(RedisModuleString *) * pop->popped);
+    RedisModuleString **zadd = RedisModule_Alloc(sizeof(RedisModuleString *) * 2 * pop->popped);
+    RedisModuleString **storedJobs = RedisModule_Calloc(pop->popped, sizeof(RedisModuleString *));
+    long long taken = 0, replaced = 0;
+    for (long long i = 0; i < pop->popped; ++i) {
+        RedisModuleString *reservedJob = NULL;
+        if (buffers[i]) {
+            reservedJob = RedisModule_CreateString(NULL, buffers[i], lens[i]);
+            cJSON_free(buffers[i]);
+            if (compressedLens[i] && compressesReservedJobs(&arguments)) {
+                storedJobs[i] = RedisModule_CreateString(NULL, compressed[i], compressedLens[i]);
+            }
+            pop->reservedJobs[i] = reservedJob;
+            pop->reserved++;
+        }
+        double score;
+        if (! takeReservedJob(&arguments, pop->jobs[i], &score)) {
+            continue;
+        }
+        removed[taken++] = pop->jobs[i];
         if (reservedJob) {
-            RedisModule_ReplyWithArray(ctx, 2);
-            RedisModule_ReplyWithString(ctx, job);
-            RedisModule_ReplyWithString(ctx, reservedJob);
-            RedisModule_FreeString(ctx, reservedJob);
+            RedisModuleString *storedJob = storedJobs[i] ? storedJobs[i] : reservedJob;
+            addReservedJob(&arguments, storedJob, score);
+            zadd[2 * replaced] = RedisModule_CreateStringPrintf(NULL, "%.17g", score);
+            zadd[2 * replaced + 1] = storedJob;
+            replaced++;
+        }
+    }
+    if (taken) {
+        if (arguments.native) {
+            RedisModule_Replicate(ctx, "laravel.native", "sccv", arguments.strList, "ZREM", "RESERVED",
+                                  removed, (size_t) taken);
         } else {
-            RedisModule_ReplyWithError(ctx, "ERR AN INVALID JOB DROPPED FROM THE QUEUE");
+            RedisModule_Replicate(ctx, "zrem", "sv", arguments.strReserved, removed, (size_t) taken);
         }
-        RedisModule_FreeString(ctx, job);
-        return JOB_RETRIEVAL_DONE;
-    } else {
-        if (arguments->blockFor < 1) {
+    }
+    replicateReserve(ctx, &arguments, zadd, replaced);
+    QueueStats *stats = getCachedQueueStats(ctx, arguments.native ? &arguments.native->stats : &pop->stats,
+                                            pop->strList, "");
+    stats->popped += pop->reserved;
+    stats->invalidJobs += pop->popped - pop->reserved;
+    if (arguments.native) {
+        deleteNativeQueueIfEmpty(arguments.list, arguments.native);
+    }
+    for (long long i = 0; i < replaced; ++i) {
+        RedisModule_FreeString(NULL, zadd[2 * i]);
+    }
+    for (long long i = 0; i < pop->popped; ++i) {
+        if (storedJobs[i]) {
+            RedisModule_FreeString(NULL, storedJobs[i]);
+        }
+    }
+    closeLaravelPopQueueKeys(&arguments);
+    RedisModule_ThreadSafeContextUnlock(ctx);
+    RedisModule_FreeThreadSafeContext(ctx);
+
+    for (long long i = 0; i < pop->popped; ++i) {
+        if (compressed[i]) {
+            RedisModule_Free(compressed[i]);
+        }
+    }
+    RedisModule_Free(storedJobs);
+    RedisModule_Free(zadd);
+    RedisModule_Free(removed);
+    RedisModule_Free(compressedLens);
+    RedisModule_Free(compressed);
+    RedisModule_Free(lens);
+    RedisModule_Free(buffers);
+    RedisModule_UnblockClient(pop->bc, pop);
+}
+
+static int reply_offloaded_pop(RedisModuleCtx *ctx, RedisModuleString **argv, int argc)
+{
+    OffloadedPop *pop = RedisModule_GetBlockedClientPrivateData(ctx);
+    replyWithReservedJobs(ctx, pop->many, pop->popped, pop->reserved, pop->jobs, pop->reservedJobs, pop->attempts);
+    return REDISMODULE_OK;
+}
+
+static void free_offloaded_pop(RedisModuleCtx *ctx, void *data)
+{
+    OffloadedPop *pop = data;
+    for (long long i = 0; i < pop->popped; ++i) {
+        RedisModule_FreeString(NULL, pop->jobs[i]);
+        if (pop->reservedJobs[i]) {
+            RedisModule_FreeString(NULL, pop->reservedJobs[i]);
+        }
+    }
+    RedisModule_FreeString(NULL, pop->strList);
+    RedisModule_FreeString(NULL, pop->strReserved);
+    RedisModule_Free(pop->jobs);
+    RedisModule_Free(pop->reservedJobs);
+    RedisModule_Free(pop->attempts);
+    RedisModule_Free(pop);
+}
+
+/**
+ * Whether to rewrite the popped jobs on an offload thread, which blocks the client until they are reserved.
+ *
+ * @param largest size of the largest popped job.
+ */
+static int shouldOffload(RedisModuleCtx *ctx, LaravelPopArguments *first, size_t largest)
+{
+    if (! ThreadPool_Started() || (long long) largest < laravelQueueConfig.offloadSize) {
+        return 0;
+    }
+    // A woken up client can't be blocked again from its reply callback, nor a client in a script or transaction.
+    return ! first->bc && ! (RedisModule_GetContextFlags(ctx) &
+            (REDISMODULE_CTX_FLAGS_LUA | REDISMODULE_CTX_FLAGS_MULTI | REDISMODULE_CTX_FLAGS_DENY_BLOCKING));
+}
+
+/**
+ * Reserve the popped jobs as they are, so they are never in neither the queue nor the reserved jobs,
+ * and hand them over to an offload thread.
+ */
+static void offloadPop(RedisModuleCtx *ctx, LaravelPopArguments *arguments, RedisModuleString **jobs, long long n,
+                       double availableAt)
+{
+    RedisModuleString *strAvailableAt = RedisModule_CreateStringPrintf(ctx, "%.17g", availableAt);
+    RedisModuleString **zadd = RedisModule_PoolAlloc(ctx, sizeof(RedisModuleString *) * 2 * n);
+    for (long long i = 0; i < n; ++i) {
+        addReservedJob(arguments, jobs[i], availableAt);
+        zadd[2 * i] = strAvailableAt;
+        zadd[2 * i + 1] = jobs[i];
+    }
+    replicateReserve(ctx, arguments, zadd, n);
+    RedisModule_FreeString(ctx, strAvailableAt);
+
+    OffloadedPop *pop = RedisModule_Calloc(1, sizeof(OffloadedPop));
+    pop->task.run = runOffloadedPop;
+    pop->db = RedisModule_GetSelectedDb(ctx);
+    pop->many = arguments->many;
+    pop->strList = RedisModule_CreateStringFromString(NULL, arguments->strList);
+    pop->strReserved = RedisModule_CreateStringFromString(NULL, arguments->strReserved);
+    pop->compress = compressesReservedJobs(arguments);
+    pop->popped = n;
+    pop->jobs = RedisModule_Alloc(sizeof(RedisModuleString *) * n);
+    memcpy(pop->jobs, jobs, sizeof(RedisModuleString *) * n);
+    pop->reservedJobs = RedisModule_Calloc(n, sizeof(RedisModuleString *));
+    pop->attempts = RedisModule_Calloc(n, sizeof(long long));
+    pop->bc = RedisModule_BlockClient(ctx, reply_offloaded_pop, NULL, free_offloaded_pop, 0);
+    ThreadPool_Submit(&pop->task);
+}
+
+#define JOB_RETRIEVAL_DONE 0
+#define JOB_RETRIEVAL_NEEDS_BLOCKING 1
+
+/**
+ * Pop up to count jobs from the first queue that has any, and reserve all of them with the same timestamp.
+ * If no queue has a job, block on all of them.
+ *
+ * @param first arguments of the queue with the highest priority.
+ * @param from set to the arguments of the queue the jobs are retrieved from, or NULL.
+ * @param retrieved number of jobs removed from the queue, including the invalid ones.
+ */
+int retrieveNextJob(RedisModuleCtx *ctx, LaravelPopArguments *first, LaravelPopArguments **from, long long *retrieved)
+{
+    *retrieved = 0;
+    *from = NULL;
+    RedisModuleString *job = NULL;
+    LaravelPopArguments *arguments;
+    for (arguments = first; arguments && ! (job = popJob(arguments)); arguments = arguments->next);
+    if (! job) {
+        for (arguments = first; arguments; arguments = arguments->next) {
+            QueueStats *stats = existingQueueStatsOf(ctx, arguments);
+            if (! stats) {
+                continue;
+            }
+            if (first->blockFor < 1) {
+                stats->emptyPops++;
+            } else {
+                stats->blockedPops++;
+            }
+        }
+        if (first->blockFor < 1) {
             RedisModule_ReplyWithNull(ctx);
             return JOB_RETRIEVAL_DONE;
-        } else {
-            closeLaravelPopKeys(arguments);
-            RedisModuleBlockedClient *bc = RedisModule_BlockClient(
-                    ctx, reply_blocking_pop, timeout_blocking_pop, free_blocking_pop_data, arguments->blockFor);
-            RedisModule_SetDisconnectCallback(bc,disconnect_blocking_pop);
-            prepareArgumentsForBlockingPop(ctx, arguments);
-            addToWaitingList(RedisModule_GetSelectedDb(ctx), bc, arguments);
-            createTimerFor(ctx, arguments->strDelayed, ":delayed");
-            createTimerFor(ctx, arguments->strReserved, ":reserved");
         }
+        first->blockedAt = ustime();
+        RedisModuleBlockedClient *bc = RedisModule_BlockClient(
+                ctx, reply_blocking_pop, timeout_blocking_pop, free_blocking_pop_data, first->blockFor);
+        RedisModule_SetDisconnectCallback(bc,disconnect_blocking_pop);
+        addToWaitingList(RedisModule_GetSelectedDb(ctx), bc, first);
+        for (arguments = first; arguments; arguments = arguments->next) {
+            createTimerFor(ctx, arguments->delayed, arguments->strDelayed, ":delayed");
+            createTimerFor(ctx, arguments->reserved, arguments->strReserved, ":reserved");
+        }
+        closeLaravelPopKeys(first);
         return JOB_RETRIEVAL_NEEDS_BLOCKING;
     }
+    *from = arguments;
+
+    double availableAt = msdelayToTime(arguments->retryAfterMs);
+    // The count is given by the client, so the buffer is sized by the job just popped and the ones left.
+    long long length = arguments->native ? (long long) arguments->native->ready.size :
+                       (long long) RedisModule_ValueLength(arguments->list);
+    long long count = arguments->count < length + 1 ? arguments->count : length + 1;
+    RedisModuleString **popped = RedisModule_PoolAlloc(ctx, sizeof(RedisModuleString *) * count);
+    long long n = 0;
+    size_t largest = 0;
+    do {
+        // Compressed jobs are reserved and replied decompressed.
+        RedisModuleString *decompressed = decompressJob(ctx, job);
+        if (decompressed) {
+            RedisModule_FreeString(ctx, job);
+            job = decompressed;
+        }
+        size_t len;
+        RedisModule_StringPtrLen(job, &len);
+        largest = len > largest ? len : largest;
+        popped[n++] = job;
+    } while (n < count && (job = popJob(arguments)));
+
+    QueueStats *stats = queueStatsOf(ctx, arguments);
+    Latency_Popped(stats, arguments->native ? (long long) arguments->native->ready.size :
+                          (long long) RedisModule_ValueLength(arguments->list), n);
+    replicatePop(ctx, arguments, n);
+    *retrieved = n;
+
+    if (shouldOffload(ctx, first, largest)) {
+        offloadPop(ctx, arguments, popped, n, availableAt);
+        return JOB_RETRIEVAL_DONE;
+    }
+
+    RedisModuleString *strAvailableAt = RedisModule_CreateStringPrintf(ctx, "%.17g", availableAt);
+    RedisModuleString **reservedJobs = RedisModule_PoolAlloc(ctx, sizeof(RedisModuleString *) * n);
+    RedisModuleString **storedJobs = RedisModule_PoolAlloc(ctx, sizeof(RedisModuleString *) * n);
+    long long *attempts = RedisModule_PoolAlloc(ctx, sizeof(long long) * n);
+    // [score, reserved job] pairs to replicate as a single zadd.
+    RedisModuleString **zadd = RedisModule_PoolAlloc(ctx, sizeof(RedisModuleString *) * 2 * n);
+    long long reserved = 0;
+    for (long long i = 0; i < n; ++i) {
+        storedJobs[i] = NULL;
+        reservedJobs[i] = reserveJob(ctx, arguments, popped[i], availableAt, &attempts[i], &storedJobs[i]);
+        if (reservedJobs[i]) {
+            zadd[2 * reserved] = strAvailableAt;
+            zadd[2 * reserved + 1] = storedJobs[i] ? storedJobs[i] : reservedJobs[i];
+            reserved++;
+        }
+    }
+    stats->popped += reserved;
+    stats->invalidJobs += n - reserved;
+    replicateReserve(ctx, arguments, zadd, reserved);
+    if (arguments->native) {
+        deleteNativeQueueIfEmpty(arguments->list, arguments->native);
+    }
+
+    replyWithReservedJobs(ctx, arguments->many, n, reserved, popped, reservedJobs, attempts);
+    for (long long i = 0; i < n; ++i) {
+        RedisModule_FreeString(ctx, popped[i]);
+        if (reservedJobs[i]) {
+            RedisModule_FreeString(ctx, reservedJobs[i]);
+        }
+        if (storedJobs[i]) {
+            RedisModule_FreeString(ctx, storedJobs[i]);
+        }
+    }
+    RedisModule_FreeString(ctx, strAvailableAt);
+    return JOB_RETRIEVAL_DONE;
 }
 
 int reply_blocking_pop(RedisModuleCtx *ctx, RedisModuleString **argv, int argc)
 {
-    LaravelPopArguments *arguments = RedisModule_GetBlockedClientPrivateData(ctx);
-    if (openLaravelPopKeys(ctx, arguments) != REDISMODULE_OK) {
-        RedisModule_ReplyWithError(ctx, "ERR Wrong key type detected after unblock");
+    LaravelPopArguments *first = RedisModule_GetBlockedClientPrivateData(ctx);
+    if (openLaravelPopKeys(ctx, first) != REDISMODULE_OK) {
+        first->jobWasDelivered = 1;
+        return RedisModule_ReplyWithError(ctx, "ERR Wrong key type detected after unblock");
+    }
+    LaravelPopArguments *wokenBy = first->wokenBy;
+    QueueStats *stats = queueStatsOf(ctx, wokenBy);
+    stats->wakeUps++;
+    Latency_Blocked(stats, ustime() - first->blockedAt);
+    first->blockFor = 0;
+    LaravelPopArguments *from;
+    long long retrieved;
+    retrieveNextJob(ctx, first, &from, &retrieved);
+    first->jobWasDelivered = 1;
+    if (from && from != wokenBy) {
+        // A queue with a higher priority had jobs, so the jobs this worker was woken up for are left to another one.
+        jobsWasPushed(RedisModule_GetSelectedDb(ctx), wokenBy->strList, first->count);
     }
-    arguments->blockFor = 0;
-    retrieveNextJob(ctx, arguments);
-    arguments->jobWasDelivered = 1;
+    return REDISMODULE_OK;
 }
 
-int Laravel_Pop_Command(RedisModuleCtx *ctx, RedisModuleString **argv, int argc)
+int popJobs(RedisModuleCtx *ctx, RedisModuleString **argv, int argc, int many)
 {
-    LaravelPopArguments *arguments = getLaravelPopArguments(ctx, argv, argc);
-    if (! arguments) {
+    LaravelPopArguments *first = getLaravelPopArguments(ctx, argv, argc, many);
+    if (! first) {
         return REDISMODULE_OK;
     }
     double currentTime = (double)ustime()/1000000;
-    long long migrated =
-            migrateExpiredJobs(ctx, arguments->list, arguments->strList, currentTime,
-                                            arguments->delayed, arguments->strDelayed, ":delayed") +
-            migrateExpiredJobs(ctx, arguments->list, arguments->strList, currentTime,
-                                   arguments->reserved, arguments->strReserved, ":reserved");
-    if (retrieveNextJob(ctx, arguments) == JOB_RETRIEVAL_DONE) {
-        releaseLaravelPopArguments(ctx, arguments);
-        if (migrated > 1) {
-            // If there is any blocked client, one migrated job is just retrieved.
-            // So we signal other migrated jobs to the blocked cliens.
-            jobsWasPushed(RedisModule_GetSelectedDb(ctx), arguments->strList, migrated - 1);
+    LaravelPopArguments *arguments;
+    long long *migrated = RedisModule_PoolAlloc(ctx, sizeof(long long) * argc / 3);
+    long long *m = migrated;
+    for (arguments = first; arguments; arguments = arguments->next, m++) {
+        if (arguments->native) {
+            *m = migrateExpiredNativeJobs(ctx, arguments->native, arguments->strList, currentTime,
+                                          arguments->strDelayed, ":delayed") +
+                 migrateExpiredNativeJobs(ctx, arguments->native, arguments->strList, currentTime,
+                                          arguments->strReserved, ":reserved");
+        } else {
+            *m = migrateExpiredJobs(ctx, arguments->list, arguments->strList, currentTime,
+                                    arguments->delayed, arguments->strDelayed, ":delayed", &arguments->stats) +
+                 migrateExpiredJobs(ctx, arguments->list, arguments->strList, currentTime,
+                                    arguments->reserved, arguments->strReserved, ":reserved", &arguments->stats);
         }
+    }
+    LaravelPopArguments *from;
+    long long retrieved;
+    if (retrieveNextJob(ctx, first, &from, &retrieved) == JOB_RETRIEVAL_DONE) {
+        for (arguments = first, m = migrated; arguments; arguments = arguments->next, m++) {
+            long long left = *m - (arguments == from ? retrieved : 0);
+            if (left > 0) {
+                // If there is any blocked client, some migrated jobs are just retrieved.
+                // So we signal other migrated jobs to the blocked cliens.
+                jobsWasPushed(RedisModule_GetSelectedDb(ctx), arguments->strList, left);
+            }
+        }
+        releaseLaravelPopArguments(ctx, first);
     } // else: migrated must be 0
     return REDISMODULE_OK;
 }
 
+/**
+ * laravel.pop <queue> <delayed> <reserved> [<queue> <delayed> <reserved> ...] <retry-after-ms> <block-for-ms>
+ *
+ * Queues are given in priority order: the job is taken from the first one that has any,
+ * and a blocked worker is woken up by a push to any of them.
+ */
+int Laravel_Pop_Command(RedisModuleCtx *ctx, RedisModuleString **argv, int argc)
+{
+    return popJobs(ctx, argv, argc, 0);
+}
+
+/**
+ * laravel.popmany <queue> <delayed> <reserved> [<queue> <delayed> <reserved> ...] <retry-after-ms> <block-for-ms> <count>
+ *
+ * Reply with a flat array of [job, reserved job] pairs.
+ */
+int Laravel_PopMany_Command(RedisModuleCtx *ctx, RedisModuleString **argv, int argc)
+{
+    return popJobs(ctx, argv, argc, 1);
+}
+
 int Create_Laravel_Pop_Command(RedisModuleCtx *ctx) {
-    if (RedisModule_CreateCommand(ctx, "laravel.pop", Laravel_Pop_Command, "write deny-oom fast", 1, 3, 3)
+    if (RedisModule_CreateCommand(ctx, "laravel.pop", Laravel_Pop_Command, "write deny-oom fast", 1, -3, 3)
+        == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
+    if (RedisModule_CreateCommand(ctx, "laravel.popmany", Laravel_PopMany_Command, "write deny-oom fast", 1, -4, 3)
         == REDISMODULE_ERR) {
         return REDISMODULE_ERR;
     }
@@ -33,6 +33,17 @@
 
 #include "redismodule.h"
 
+/**
+ * Pop jobs like laravel.pop or laravel.popmany, blocking the client if there is none.
+ *
+ * @param ctx
+ * @param argv the arguments of laravel.pop or laravel.popmany.
+ * @param argc
+ * @param many
+ * @return REDISMODULE_OK
+ */
+int popJobs(RedisModuleCtx *ctx, RedisModuleString **argv, int argc, int many);
+
 int Create_Laravel_Pop_Command(RedisModuleCtx *ctx);
 
 #endif //LARAVEL_QUEUE_LARAVEL_POP_H
@@ -31,20 +31,33 @@
 #include <string.h>
 #include "laravel-push.h"
 #include "blocking-pop.h"
+#include "queue-type.h"
+#include "stats.h"
+#include "latency.h"
+#include "compression.h"
+#include "config.h"
+#include "envelope.h"
 
 typedef struct LaravelPushArguments {
     RedisModuleKey *queue;
     RedisModuleString *strQueue;
     RedisModuleString *job;
+    RedisModuleString *stored;
+    LaravelQueue *native;
+    QueueStats *stats;
 } LaravelPushArguments;
 
 
-void releaseLaravelPushArguments(LaravelPushArguments *arguments)
+void releaseLaravelPushArguments(RedisModuleCtx *ctx, LaravelPushArguments *arguments)
 {
     if (arguments->queue) {
         RedisModule_CloseKey(arguments->queue);
         arguments->queue = NULL;
     }
+    if (arguments->stored) {
+        RedisModule_FreeString(ctx, arguments->stored);
+        arguments->stored = NULL;
+    }
 }
 
 LaravelPushArguments * getLaravelPushArguments(RedisModuleCtx *ctx, RedisModuleString **argv, int argc, LaravelPushArguments *arguments)
@@ -56,20 +69,30 @@ LaravelPushArguments * getLaravelPushArguments(RedisModuleCtx *ctx, RedisModuleS
 
     memset(arguments, 0, sizeof(LaravelPushArguments));
 
+    if (! isAcceptedJob(argv[2])) {
+        RedisModule_ReplyWithError(ctx, INVALID_JOB_ERROR);
+        return NULL;
+    }
+
     arguments->queue = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_WRITE);
     arguments->strQueue = argv[1];
-    switch (RedisModule_KeyType(arguments->queue)) {
-        case REDISMODULE_KEYTYPE_EMPTY:
-            break;
-        case REDISMODULE_KEYTYPE_LIST:
-            break;
-        default:
-            releaseLaravelPushArguments(arguments);
-            RedisModule_ReplyWithError(ctx, "ERR WRONG KEY TYPE FOR KEYS[1] (list expected for the main queue)");
-            return NULL;
+    arguments->native = getNativeQueue(ctx, arguments->queue, arguments->strQueue, 1);
+    if (! arguments->native) {
+        switch (RedisModule_KeyType(arguments->queue)) {
+            case REDISMODULE_KEYTYPE_EMPTY:
+                break;
+            case REDISMODULE_KEYTYPE_LIST:
+                break;
+            default:
+                releaseLaravelPushArguments(ctx, arguments);
+                RedisModule_ReplyWithError(ctx, "ERR WRONG KEY TYPE FOR KEYS[1] (list expected for the main queue)");
+                return NULL;
+        }
     }
 
-    arguments->job = argv[2];
+    arguments->stats = getCachedQueueStats(ctx, arguments->native ? &arguments->native->stats : NULL, argv[1], "");
+    arguments->stored = storedJobOf(ctx, argv[2], arguments->stats);
+    arguments->job = arguments->stored ? arguments->stored : argv[2];
 
     return arguments;
 }
@@ -81,17 +104,100 @@ int Laravel_Push_Command(RedisModuleCtx *ctx, RedisModuleString **argv, int argc
         return REDISMODULE_ERR;
     }
 
-    if (RedisModule_ListPush(arguments.queue, REDISMODULE_LIST_TAIL, arguments.job) != REDISMODULE_OK) {
+    if (arguments.native) {
+        RedisModule_RetainString(NULL, arguments.job);
+        JobDeque_Push_Back(&arguments.native->ready, arguments.job);
+        RedisModule_Replicate(ctx, "laravel.native", "scs", arguments.strQueue, "RPUSH", arguments.job);
+        RedisModule_ReplyWithLongLong(ctx, arguments.native->ready.size);
+        arguments.stats->pushed++;
+        Latency_Pushed(arguments.stats, (long long) arguments.native->ready.size, 1, NULL);
+        jobsWasPushed(RedisModule_GetSelectedDb(ctx), arguments.strQueue, 1);
+    } else if (RedisModule_ListPush(arguments.queue, REDISMODULE_LIST_TAIL, arguments.job) != REDISMODULE_OK) {
         RedisModule_ReplyWithError(ctx, "ERR Unknown error in rpush");
     } else {
         RedisModule_Replicate(ctx, "rpush", "ss", arguments.strQueue, arguments.job);
-        RedisModuleCallReply *reply = RedisModule_Call(ctx, "llen", "s", arguments.strQueue);
-        RedisModule_ReplyWithLongLong(ctx, RedisModule_CallReplyInteger(reply));
-        RedisModule_FreeCallReply(reply);
+        RedisModule_ReplyWithLongLong(ctx, RedisModule_ValueLength(arguments.queue));
+        arguments.stats->pushed++;
+        Latency_Pushed(arguments.stats, (long long) RedisModule_ValueLength(arguments.queue), 1, NULL);
         jobsWasPushed(RedisModule_GetSelectedDb(ctx), arguments.strQueue, 1);
     }
 
-    releaseLaravelPushArguments(&arguments);
+    releaseLaravelPushArguments(ctx, &arguments);
+
+    return REDISMODULE_OK;
+}
+
+/**
+ * laravel.pushmany <queue> <job> [job ...]
+ *
+ * Append all the jobs to the queue with a single replicated rpush and wake up the blocked workers in one pass.
+ */
+int Laravel_PushMany_Command(RedisModuleCtx *ctx, RedisModuleString **argv, int argc)
+{
+    if (argc < 3) {
+        return RedisModule_WrongArity(ctx);
+    }
+    for (int i = 2; i < argc; ++i) {
+        if (! isAcceptedJob(argv[i])) {
+            return RedisModule_ReplyWithError(ctx, INVALID_JOB_ERROR);
+        }
+    }
+
+    RedisModuleKey *queue = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_WRITE);
+    LaravelQueue *native = getNativeQueue(ctx, queue, argv[1], 1);
+    int type = RedisModule_KeyType(queue);
+    if (! native && type != REDISMODULE_KEYTYPE_EMPTY && type != REDISMODULE_KEYTYPE_LIST) {
+        RedisModule_CloseKey(queue);
+        return RedisModule_ReplyWithError(ctx, "ERR WRONG KEY TYPE FOR KEYS[1] (list expected for the main queue)");
+    }
+
+    QueueStats *stats = getCachedQueueStats(ctx, native ? &native->stats : NULL, argv[1], "");
+    RedisModuleString **jobs = argv + 2;
+    int stored = 0;
+    if (laravelQueueConfig.jobEnvelope || laravelQueueConfig.compressSize) {
+        jobs = RedisModule_PoolAlloc(ctx, sizeof(RedisModuleString *) * (argc - 2));
+        for (int i = 2; i < argc; ++i) {
+            RedisModuleString *job = storedJobOf(ctx, argv[i], stats);
+            jobs[i - 2] = job ? job : argv[i];
+            stored += job != NULL;
+        }
+    }
+
+    long long n = 0;
+    if (native) {
+        for (int i = 0; i < argc - 2; ++i, ++n) {
+            RedisModule_RetainString(NULL, jobs[i]);
+            JobDeque_Push_Back(&native->ready, jobs[i]);
+        }
+        RedisModule_Replicate(ctx, "laravel.native", "scv", argv[1], "RPUSH", jobs, (size_t) n);
+    } else {
+        for (int i = 0; i < argc - 2; ++i, ++n) {
+            if (RedisModule_ListPush(queue, REDISMODULE_LIST_TAIL, jobs[i]) != REDISMODULE_OK) {
+                break;
+            }
+        }
+        if (n) {
+            RedisModule_Replicate(ctx, "rpush", "sv", argv[1], jobs, (size_t) n);
+        }
+    }
+    for (int i = 0; stored && i < argc - 2; ++i) {
+        if (jobs[i] != argv[i + 2]) {
+            RedisModule_FreeString(ctx, jobs[i]);
+        }
+    }
+    long long length = native ? (long long) native->ready.size : (long long) RedisModule_ValueLength(queue);
+    if (n < argc - 2) {
+        RedisModule_ReplyWithError(ctx, "ERR Unknown error in rpush");
+    } else {
+        RedisModule_ReplyWithLongLong(ctx, length);
+    }
+    RedisModule_CloseKey(queue);
+
+    if (n) {
+        stats->pushed += n;
+        Latency_Pushed(stats, length, n, NULL);
+        jobsWasPushed(RedisModule_GetSelectedDb(ctx), argv[1], n);
+    }
 
     return REDISMODULE_OK;
 }
@@ -102,6 +208,10 @@ int Create_Laravel_Push_Command(RedisModuleCtx *ctx)
         == REDISMODULE_ERR) {
         return REDISMODULE_ERR;
     }
+    if (RedisModule_CreateCommand(ctx, "laravel.pushmany", Laravel_PushMany_Command, "write deny-oom fast", 1, 1, 1)
+        == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
 
     return REDISMODULE_OK;
 }
\ No newline at end of file
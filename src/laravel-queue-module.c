@@ -33,7 +33,15 @@
 #include "laravel-later.h"
 #include "laravel-delete-reserved.h"
 #include "laravel-release-reserved.h"
+#include "laravel-extend-reserved.h"
+#include "laravel-next.h"
 #include "blocking-pop.h"
+#include "config.h"
+#include "job-attempts.h"
+#include "queue-type.h"
+#include "stats.h"
+#include "latency.h"
+#include "thread-pool.h"
 #include "../vendor/cJSON.h"
 
 cJSON_Hooks cJSONHooks;
@@ -53,6 +61,20 @@ int RedisModule_OnLoad(RedisModuleCtx *ctx, RedisModuleString **argv, int argc)
         return REDISMODULE_ERR;
     }
 
+    if (parseModuleArguments(ctx, argv, argc) == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
+
+    if (Create_Laravel_Queue_Type(ctx) == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
+
+    initJobAttempts();
+    if (ThreadPool_Start(laravelQueueConfig.offloadThreads) == REDISMODULE_ERR) {
+        RedisModule_Log(ctx, "warning", "Can't start the offload threads");
+        return REDISMODULE_ERR;
+    }
+
     if (initWaitingList() == REDISMODULE_ERR) {
         return REDISMODULE_ERR;
     }
@@ -72,5 +94,23 @@ int RedisModule_OnLoad(RedisModuleCtx *ctx, RedisModuleString **argv, int argc)
     if (Create_Laravel_Release_Reserved_Command(ctx) == REDISMODULE_ERR) {
         return REDISMODULE_ERR;
     }
+    if (Create_Laravel_Extend_Reserved_Command(ctx) == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
+    if (Create_Laravel_Next_Command(ctx) == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
+    if (Create_Laravel_Draining_Command(ctx) == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
+    if (Create_Laravel_Memory_Command(ctx) == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
+    if (Create_Laravel_Stats_Command(ctx) == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
+    if (Create_Laravel_Latency_Command(ctx) == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
     return REDISMODULE_OK;
 }
@@ -31,6 +31,10 @@
 #include <string.h>
 #include "laravel-release-reserved.h"
 #include "blocking-pop.h"
+#include "queue-type.h"
+#include "stats.h"
+#include "compression.h"
+#include "envelope.h"
 
 typedef struct LaravelReleaseArguments {
     RedisModuleKey *delayed;
@@ -38,8 +42,16 @@ typedef struct LaravelReleaseArguments {
     RedisModuleString *strDelayed;
     RedisModuleString *strReserved;
     RedisModuleString *payload;
+
+    /**
+     * The compressed form of the payload that is released, to be freed.
+     */
+    RedisModuleString *compressed;
     long long delayMs;
     RedisModuleString *strAvailableAt;
+    LaravelQueue *native;
+    RedisModuleKey *nativeKey;
+    RedisModuleString *strNativeQueue;
 } LaravelReleaseArguments;
 
 void releaseLaravelReleaseArguments(RedisModuleCtx *ctx, LaravelReleaseArguments *arguments)
@@ -56,45 +68,70 @@ void releaseLaravelReleaseArguments(RedisModuleCtx *ctx, LaravelReleaseArguments
         RedisModule_FreeString(ctx, arguments->strAvailableAt);
         arguments->strAvailableAt = NULL;
     }
+    if (arguments->nativeKey) {
+        RedisModule_CloseKey(arguments->nativeKey);
+        arguments->nativeKey = NULL;
+    }
+    if (arguments->strNativeQueue) {
+        RedisModule_FreeString(ctx, arguments->strNativeQueue);
+        arguments->strNativeQueue = NULL;
+    }
+    if (arguments->compressed) {
+        RedisModule_FreeString(ctx, arguments->compressed);
+        arguments->compressed = NULL;
+    }
 }
 
-LaravelReleaseArguments *getLaravelReleaseArguments(RedisModuleCtx *ctx, RedisModuleString **argv, int argc, LaravelReleaseArguments *arguments)
+LaravelReleaseArguments *getLaravelReleaseArguments(RedisModuleCtx *ctx, RedisModuleString **argv, int argc, int many,
+                                                    LaravelReleaseArguments *arguments)
 {
     memset(arguments, 0, sizeof(LaravelReleaseArguments));
 
-    if (argc != 5) {
+    if (many ? argc < 5 : argc != 5) {
         RedisModule_WrongArity(ctx);
         return NULL;
     }
-
-    arguments->delayed = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_WRITE);
-    switch (RedisModule_KeyType(arguments->delayed)) {
-        case REDISMODULE_KEYTYPE_EMPTY:
-            break;
-        case REDISMODULE_KEYTYPE_ZSET:
-            break;
-        default:
-            RedisModule_ReplyWithError(ctx, "ERR WRONG KEY TYPE FOR KEYS[1] (zset expected for delayed queue)");
+    for (int i = many ? 4 : 3; i < (many ? argc : 4); ++i) {
+        if (! isAcceptedJob(argv[i])) {
+            RedisModule_ReplyWithError(ctx, INVALID_JOB_ERROR);
             return NULL;
+        }
     }
-    arguments->strDelayed = argv[1];
 
-    arguments->reserved = RedisModule_OpenKey(ctx, argv[2], REDISMODULE_WRITE);
-    switch (RedisModule_KeyType(arguments->reserved)) {
-        case REDISMODULE_KEYTYPE_EMPTY:
-            break;
-        case REDISMODULE_KEYTYPE_ZSET:
-            break;
-        default:
-            RedisModule_ReplyWithError(ctx, "ERR WRONG KEY TYPE FOR KEYS[2] (zset expected for reserved queue)");
-            return NULL;
+    arguments->native = openNativeQueueOf(ctx, argv[2], ":reserved", 0, &arguments->nativeKey, &arguments->strNativeQueue);
+    if (! arguments->native) {
+        arguments->delayed = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_WRITE);
+        switch (RedisModule_KeyType(arguments->delayed)) {
+            case REDISMODULE_KEYTYPE_EMPTY:
+                break;
+            case REDISMODULE_KEYTYPE_ZSET:
+                break;
+            default:
+                RedisModule_ReplyWithError(ctx, "ERR WRONG KEY TYPE FOR KEYS[1] (zset expected for delayed queue)");
+                return NULL;
+        }
+
+        arguments->reserved = RedisModule_OpenKey(ctx, argv[2], REDISMODULE_WRITE);
+        switch (RedisModule_KeyType(arguments->reserved)) {
+            case REDISMODULE_KEYTYPE_EMPTY:
+                break;
+            case REDISMODULE_KEYTYPE_ZSET:
+                break;
+            default:
+                RedisModule_ReplyWithError(ctx, "ERR WRONG KEY TYPE FOR KEYS[2] (zset expected for reserved queue)");
+                return NULL;
+        }
     }
+    arguments->strDelayed = argv[1];
     arguments->strReserved = argv[2];
 
-    arguments->payload = argv[3];
+    if (! many) {
+        arguments->payload = argv[3];
+    }
 
-    if (RedisModule_StringToLongLong(argv[4], &arguments->delayMs) != REDISMODULE_OK) {
-        RedisModule_ReplyWithError(ctx, "ERR ARGV[2] IS NOT A VALID INTEGER (delay in milliseconds)");
+    if (RedisModule_StringToLongLong(argv[many ? 3 : 4], &arguments->delayMs) != REDISMODULE_OK) {
+        RedisModule_ReplyWithError(ctx, many ? "ERR ARGV[1] IS NOT A VALID INTEGER (delay in milliseconds)"
+                                            : "ERR ARGV[2] IS NOT A VALID INTEGER (delay in milliseconds)");
         return NULL;
     }
     arguments->strAvailableAt = RedisModule_CreateStringPrintf(ctx, "%f", msdelayToTime(arguments->delayMs));
@@ -102,22 +139,169 @@ LaravelReleaseArguments *getLaravelReleaseArguments(RedisModuleCtx *ctx, RedisMo
     return arguments;
 }
 
+/**
+ * The counters of the queue, held by its native queue.
+ */
+static QueueStats * reservedQueueStats(RedisModuleCtx *ctx, LaravelReleaseArguments *arguments)
+{
+    return getCachedQueueStats(ctx, arguments->native ? &arguments->native->stats : NULL, arguments->strReserved,
+                               ":reserved");
+}
+
+/**
+ * The form a job that is not reserved is delayed in, compressed like a pushed job.
+ *
+ * @param compressed set to the compressed job to be freed, or NULL.
+ */
+static RedisModuleString * unreservedJobOf(RedisModuleCtx *ctx, RedisModuleString *job, RedisModuleString **compressed)
+{
+    *compressed = compressJob(ctx, job, NULL);
+    return *compressed ? *compressed : job;
+}
+
+/**
+ * Release a reserved job, without replying unless the arguments are invalid.
+ */
+int releaseReservedJob(RedisModuleCtx *ctx, RedisModuleString **argv, int argc)
+{
+    LaravelReleaseArguments arguments;
+    if (! getLaravelReleaseArguments(ctx, argv, argc, 0, &arguments)) {
+        releaseLaravelReleaseArguments(ctx, &arguments);
+        return REDISMODULE_ERR;
+    }
+
+    double availableAt;
+    RedisModule_StringToDouble(arguments.strAvailableAt, &availableAt);
+    if (arguments.native) {
+        // The payload may be the id of the job: the job itself is released and replicated.
+        RedisModuleString *job = takeReservedNativeJob(ctx, &arguments.native->reserved, arguments.payload);
+        if (job) {
+            RedisModule_Replicate(ctx, "laravel.native", "sccs", arguments.strNativeQueue, "ZREM", "RESERVED", job);
+        } else if (! JobHeap_IsId(&arguments.native->reserved, arguments.payload)) {
+            job = unreservedJobOf(ctx, arguments.payload, &arguments.compressed);
+            RedisModule_RetainString(NULL, job);
+        }
+        if (job) {
+            RedisModule_Replicate(ctx, "laravel.native", "sccss", arguments.strNativeQueue, "ZADD", "DELAYED",
+                                  arguments.strAvailableAt, job);
+            JobHeap_Add(&arguments.native->delayed, availableAt, job);
+        }
+    } else {
+        RedisModuleString *member = removeReservedMember(ctx, arguments.reserved, arguments.payload);
+        if (member) {
+            RedisModule_Replicate(ctx, "zrem", "ss", arguments.strReserved, member);
+            if (member != arguments.payload) {
+                arguments.compressed = member;
+            }
+        } else {
+            member = unreservedJobOf(ctx, arguments.payload, &arguments.compressed);
+        }
+        RedisModule_ZsetAdd(arguments.delayed, availableAt, member, NULL);
+        RedisModule_Replicate(ctx, "zadd", "sss", arguments.strDelayed, arguments.strAvailableAt, member);
+    }
+
+    reservedQueueStats(ctx, &arguments)->released++;
+    // The timer of the reserved queue is left as it is: if it fires early, it only re-arms for the next job.
+    scheduleIfEarlier(ctx, arguments.delayed, arguments.strDelayed, availableAt, ":delayed");
+
+    releaseLaravelReleaseArguments(ctx, &arguments);
+    return REDISMODULE_OK;
+}
+
 int Laravel_Release_Command(RedisModuleCtx *ctx, RedisModuleString **argv, int argc)
+{
+    if (releaseReservedJob(ctx, argv, argc) != REDISMODULE_OK) {
+        return REDISMODULE_ERR;
+    }
+    return RedisModule_ReplyWithSimpleString(ctx, "OK");
+}
+
+/**
+ * laravel.releasemany <queue>:delayed <queue>:reserved <delay-ms> <job> [job ...]
+ *
+ * Move all the jobs from the reserved to the delayed queue with a single replicated zrem and zadd, and reply with the
+ * number of released jobs.
+ */
+int Laravel_ReleaseMany_Command(RedisModuleCtx *ctx, RedisModuleString **argv, int argc)
 {
     LaravelReleaseArguments arguments;
-    if (! getLaravelReleaseArguments(ctx, argv, argc, &arguments)) {
+    if (! getLaravelReleaseArguments(ctx, argv, argc, 1, &arguments)) {
         releaseLaravelReleaseArguments(ctx, &arguments);
         return REDISMODULE_ERR;
     }
 
-    RedisModuleCallReply *deleted = RedisModule_Call(ctx, "zrem", "ss!", arguments.strReserved, arguments.payload);
-    RedisModule_FreeCallReply(deleted);
-    RedisModuleCallReply *added = RedisModule_Call(ctx, "zadd", "sss!", arguments.strDelayed, arguments.strAvailableAt, arguments.payload);
-    RedisModule_FreeCallReply(added);
+    double availableAt;
+    RedisModule_StringToDouble(arguments.strAvailableAt, &availableAt);
+    int n = argc - 4;
+    // The compressed forms of the jobs that are released, to be freed.
+    RedisModuleString **compressed = RedisModule_PoolAlloc(ctx, sizeof(RedisModuleString *) * n);
+    memset(compressed, 0, sizeof(RedisModuleString *) * n);
+    // The removed reserved jobs, and [score, job] pairs to add to the delayed queue.
+    RedisModuleString **removed = RedisModule_PoolAlloc(ctx, sizeof(RedisModuleString *) * n);
+    RedisModuleString **zadd = RedisModule_PoolAlloc(ctx, sizeof(RedisModuleString *) * 2 * n);
+    long long deleted = 0, released = 0;
+    if (arguments.native) {
+        for (int i = 0; i < n; ++i) {
+            // The member may be the id of the job: the job itself is released and replicated.
+            RedisModuleString *job = takeReservedNativeJob(ctx, &arguments.native->reserved, argv[4 + i]);
+            if (job) {
+                removed[deleted++] = job;
+            } else if (! JobHeap_IsId(&arguments.native->reserved, argv[4 + i])) {
+                job = unreservedJobOf(ctx, argv[4 + i], &compressed[i]);
+                RedisModule_RetainString(NULL, job);
+            }
+            if (job) {
+                zadd[2 * released] = arguments.strAvailableAt;
+                zadd[2 * released + 1] = job;
+                released++;
+            }
+        }
+        if (deleted) {
+            RedisModule_Replicate(ctx, "laravel.native", "sccv", arguments.strNativeQueue, "ZREM", "RESERVED",
+                                  removed, (size_t) deleted);
+        }
+        if (released) {
+            RedisModule_Replicate(ctx, "laravel.native", "sccv", arguments.strNativeQueue, "ZADD", "DELAYED",
+                                  zadd, (size_t) (2 * released));
+        }
+        for (long long i = 0; i < released; ++i) {
+            JobHeap_Add(&arguments.native->delayed, availableAt, zadd[2 * i + 1]);
+        }
+    } else {
+        for (int i = 0; i < n; ++i) {
+            RedisModuleString *member = removeReservedMember(ctx, arguments.reserved, argv[4 + i]);
+            if (member) {
+                removed[deleted++] = member;
+                if (member != argv[4 + i]) {
+                    compressed[i] = member;
+                }
+            } else {
+                member = unreservedJobOf(ctx, argv[4 + i], &compressed[i]);
+            }
+            RedisModule_ZsetAdd(arguments.delayed, availableAt, member, NULL);
+            zadd[2 * released] = arguments.strAvailableAt;
+            zadd[2 * released + 1] = member;
+            released++;
+        }
+        if (deleted) {
+            RedisModule_Replicate(ctx, "zrem", "sv", arguments.strReserved, removed, (size_t) deleted);
+        }
+        RedisModule_Replicate(ctx, "zadd", "sv", arguments.strDelayed, zadd, (size_t) (2 * released));
+    }
+    for (int i = 0; i < n; ++i) {
+        if (compressed[i]) {
+            RedisModule_FreeString(ctx, compressed[i]);
+        }
+    }
 
-    RedisModule_ReplyWithSimpleString(ctx, "OK");
-    updateTimerFor(ctx, arguments.strReserved, ":reserved");
-    updateTimerFor(ctx, arguments.strDelayed, ":delayed");
+    RedisModule_ReplyWithLongLong(ctx, released);
+    if (released) {
+        reservedQueueStats(ctx, &arguments)->released += released;
+    }
+    // The timer of the reserved queue is left as it is: if it fires early, it only re-arms for the next job.
+    if (released) {
+        scheduleIfEarlier(ctx, arguments.delayed, arguments.strDelayed, availableAt, ":delayed");
+    }
 
     releaseLaravelReleaseArguments(ctx, &arguments);
     return REDISMODULE_OK;
@@ -129,6 +313,10 @@ int Create_Laravel_Release_Reserved_Command(RedisModuleCtx *ctx)
         == REDISMODULE_ERR) {
         return REDISMODULE_ERR;
     }
+    if (RedisModule_CreateCommand(ctx, "laravel.releasemany", Laravel_ReleaseMany_Command, "write deny-oom fast", 1, 2, 1)
+        == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
 
     return REDISMODULE_OK;
 }
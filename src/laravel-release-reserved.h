@@ -33,6 +33,16 @@
 
 #include "redismodule.h"
 
+/**
+ * Release a reserved job, without replying unless the arguments are invalid.
+ *
+ * @param ctx
+ * @param argv the arguments of laravel.release.
+ * @param argc
+ * @return REDISMODULE_OK, or REDISMODULE_ERR after replying with an error.
+ */
+int releaseReservedJob(RedisModuleCtx *ctx, RedisModuleString **argv, int argc);
+
 int Create_Laravel_Release_Reserved_Command(RedisModuleCtx *ctx);
 
 #endif //LARAVEL_QUEUE_RELEASE_RESERVED_H
@@ -0,0 +1,250 @@
+/*
+ * Copyright (c) 2018, Hamid Alaei Varnosfaderani
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <strings.h>
+#include "latency.h"
+#include "blocking-pop.h"
+
+/**
+ * Stop tracking ready times of a queue with more jobs than this, until its list gets empty.
+ */
+#define LATENCY_MAX_READY_TIMES (1 << 20)
+#define LATENCY_INITIAL_READY_TIMES 64
+
+/**
+ * Bytes taken by the ready times of all queues.
+ */
+static size_t readyTimesBytes = 0;
+
+static QueueLatency * getQueueLatency(QueueStats *stats)
+{
+    if (! stats->latency) {
+        stats->latency = RedisModule_Calloc(1, sizeof(QueueLatency));
+        stats->latency->readyTimes.valid = 1;
+    }
+    return stats->latency;
+}
+
+/**
+ * Free the buffer of the ready times if it is larger than the given capacity.
+ */
+static void shrinkReadyTimes(ReadyTimes *readyTimes, size_t capacity)
+{
+    if (readyTimes->capacity > capacity) {
+        RedisModule_Free(readyTimes->times);
+        readyTimesBytes -= readyTimes->capacity * sizeof(long long);
+        readyTimes->times = NULL;
+        readyTimes->head = readyTimes->size = readyTimes->capacity = 0;
+    }
+}
+
+/**
+ * Stop tracking the ready times until the list gets empty, and free them meanwhile.
+ */
+static void invalidateReadyTimes(ReadyTimes *readyTimes)
+{
+    readyTimes->valid = 0;
+    shrinkReadyTimes(readyTimes, 0);
+}
+
+/**
+ * Check the tracked ready times still match the list, starting over when the list is empty.
+ */
+static int readyTimesInSync(ReadyTimes *readyTimes, long long length)
+{
+    if (length == 0) {
+        readyTimes->head = readyTimes->size = 0;
+        readyTimes->valid = 1;
+        shrinkReadyTimes(readyTimes, LATENCY_INITIAL_READY_TIMES);
+    } else if (readyTimes->valid && (long long) readyTimes->size != length) {
+        invalidateReadyTimes(readyTimes);
+    }
+    return readyTimes->valid;
+}
+
+void Latency_Pushed(QueueStats *stats, long long length, long long n, const long long *readyAt)
+{
+    ReadyTimes *readyTimes = &getQueueLatency(stats)->readyTimes;
+    if (! readyTimesInSync(readyTimes, length - n)) {
+        return;
+    }
+    if (readyTimes->size + n > LATENCY_MAX_READY_TIMES) {
+        invalidateReadyTimes(readyTimes);
+        return;
+    }
+    if (readyTimes->size + n > readyTimes->capacity) {
+        size_t capacity = readyTimes->capacity ? readyTimes->capacity : LATENCY_INITIAL_READY_TIMES;
+        while (capacity < readyTimes->size + n) {
+            capacity *= 2;
+        }
+        long long *times = RedisModule_Alloc(capacity * sizeof(long long));
+        for (size_t i = 0; i < readyTimes->size; ++i) {
+            times[i] = readyTimes->times[(readyTimes->head + i) & (readyTimes->capacity - 1)];
+        }
+        RedisModule_Free(readyTimes->times);
+        readyTimesBytes += (capacity - readyTimes->capacity) * sizeof(long long);
+        readyTimes->times = times;
+        readyTimes->head = 0;
+        readyTimes->capacity = capacity;
+    }
+    long long now = ustime();
+    for (long long i = 0; i < n; ++i) {
+        readyTimes->times[(readyTimes->head + readyTimes->size++) & (readyTimes->capacity - 1)] = readyAt ? readyAt[i] : now;
+    }
+}
+
+void Latency_Popped(QueueStats *stats, long long length, long long n)
+{
+    QueueLatency *latency = getQueueLatency(stats);
+    ReadyTimes *readyTimes = &latency->readyTimes;
+    if (! readyTimesInSync(readyTimes, length + n)) {
+        return;
+    }
+    long long now = ustime();
+    for (long long i = 0; i < n; ++i) {
+        Histogram_Record(&latency->ready, now - readyTimes->times[readyTimes->head]);
+        readyTimes->head = (readyTimes->head + 1) & (readyTimes->capacity - 1);
+        readyTimes->size--;
+    }
+    if (! readyTimes->size) {
+        shrinkReadyTimes(readyTimes, LATENCY_INITIAL_READY_TIMES);
+    }
+}
+
+void Latency_Free(QueueLatency *latency)
+{
+    shrinkReadyTimes(&latency->readyTimes, 0);
+    RedisModule_Free(latency);
+}
+
+size_t Latency_ReadyTimesMemory(void)
+{
+    return readyTimesBytes;
+}
+
+void Latency_Blocked(QueueStats *stats, long long us)
+{
+    Histogram_Record(&getQueueLatency(stats)->blocked, us);
+}
+
+void Latency_Timer(QueueStats *stats, long long us)
+{
+    Histogram_Record(&getQueueLatency(stats)->timer, us);
+}
+
+static void resetQueueLatency(QueueStats *stats)
+{
+    if (stats->latency) {
+        Histogram_Reset(&stats->latency->ready);
+        Histogram_Reset(&stats->latency->blocked);
+        Histogram_Reset(&stats->latency->timer);
+    }
+}
+
+/**
+ * laravel.latency QUANTILES <queue> <ready|blocked|timer> [quantile ...]
+ * laravel.latency RESET [queue]
+ *
+ * QUANTILES replies with [count, min, max, value at each quantile] in microseconds. The default quantiles are 0.5, 0.99 and 0.999.
+ * RESET clears the histograms of the queue, or of all queues of the database.
+ */
+int Laravel_Latency_Command(RedisModuleCtx *ctx, RedisModuleString **argv, int argc)
+{
+    if (argc < 2) {
+        return RedisModule_WrongArity(ctx);
+    }
+    const char *subcommand = RedisModule_StringPtrLen(argv[1], NULL);
+    if (strcasecmp(subcommand, "RESET") == 0) {
+        if (argc > 3) {
+            return RedisModule_WrongArity(ctx);
+        }
+        if (argc == 3) {
+            QueueStats *stats = findQueueStats(ctx, argv[2]);
+            if (stats) {
+                resetQueueLatency(stats);
+            }
+        } else {
+            RedisModuleDict *queues = getQueueStatsDict(ctx);
+            if (queues) {
+                RedisModuleDictIter *iter = RedisModule_DictIteratorStartC(queues, "^", NULL, 0);
+                QueueStats *stats;
+                while (RedisModule_DictNextC(iter, NULL, (void **) &stats)) {
+                    resetQueueLatency(stats);
+                }
+                RedisModule_DictIteratorStop(iter);
+            }
+        }
+        return RedisModule_ReplyWithSimpleString(ctx, "OK");
+    }
+    if (strcasecmp(subcommand, "QUANTILES") != 0) {
+        return RedisModule_ReplyWithError(ctx, "ERR UNKNOWN SUBCOMMAND (QUANTILES or RESET expected)");
+    }
+    if (argc < 4) {
+        return RedisModule_WrongArity(ctx);
+    }
+    double defaults[] = {0.5, 0.99, 0.999};
+    int n = argc > 4 ? argc - 4 : 3;
+    double *quantiles = argc > 4 ? RedisModule_PoolAlloc(ctx, n * sizeof(double)) : defaults;
+    for (int i = 0; argc > 4 && i < n; ++i) {
+        if (RedisModule_StringToDouble(argv[4 + i], &quantiles[i]) != REDISMODULE_OK || quantiles[i] < 0 || quantiles[i] > 1) {
+            return RedisModule_ReplyWithError(ctx, "ERR INVALID QUANTILE (number between 0 and 1 expected)");
+        }
+    }
+    const char *kind = RedisModule_StringPtrLen(argv[3], NULL);
+    QueueStats *stats = findQueueStats(ctx, argv[2]);
+    Histogram *histogram = NULL;
+    if (strcasecmp(kind, "ready") == 0) {
+        histogram = stats && stats->latency ? &stats->latency->ready : NULL;
+    } else if (strcasecmp(kind, "blocked") == 0) {
+        histogram = stats && stats->latency ? &stats->latency->blocked : NULL;
+    } else if (strcasecmp(kind, "timer") == 0) {
+        histogram = stats && stats->latency ? &stats->latency->timer : NULL;
+    } else {
+        return RedisModule_ReplyWithError(ctx, "ERR UNKNOWN HISTOGRAM (ready, blocked or timer expected)");
+    }
+    RedisModule_ReplyWithArray(ctx, 3 + n);
+    RedisModule_ReplyWithLongLong(ctx, histogram ? (long long) histogram->total : 0);
+    RedisModule_ReplyWithLongLong(ctx, histogram ? (long long) histogram->min : 0);
+    RedisModule_ReplyWithLongLong(ctx, histogram ? (long long) histogram->max : 0);
+    for (int i = 0; i < n; ++i) {
+        RedisModule_ReplyWithLongLong(ctx, histogram ? (long long) Histogram_Quantile(histogram, quantiles[i]) : 0);
+    }
+    return REDISMODULE_OK;
+}
+
+int Create_Laravel_Latency_Command(RedisModuleCtx *ctx)
+{
+    if (RedisModule_CreateCommand(ctx, "laravel.latency", Laravel_Latency_Command, "readonly fast", 0, 0, 0)
+        == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
+
+    return REDISMODULE_OK;
+}
@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2018, Hamid Alaei Varnosfaderani
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LARAVEL_QUEUE_LATENCY_H
+#define LARAVEL_QUEUE_LATENCY_H
+
+#include "redismodule.h"
+#include "histogram.h"
+#include "stats.h"
+
+/**
+ * Times the jobs of a queue became ready, in the order of the list, to measure how long they wait before pop.
+ * It stops tracking when the list is changed by other commands, until the list gets empty again.
+ */
+typedef struct ReadyTimes
+{
+    long long *times;
+    size_t head;
+    size_t size;
+    size_t capacity;
+    char valid;
+} ReadyTimes;
+
+/**
+ * Latency histograms of a queue, in microseconds.
+ */
+typedef struct QueueLatency
+{
+    /**
+     * From when a job becomes ready in the list until it is popped.
+     */
+    Histogram ready;
+
+    /**
+     * From when a worker blocks until it is woken up or times out.
+     */
+    Histogram blocked;
+
+    /**
+     * From when jobs of a delayed/reserved sorted set become available until the timer migrates them.
+     */
+    Histogram timer;
+
+    ReadyTimes readyTimes;
+} QueueLatency;
+
+/**
+ * Record that jobs are appended to the list of a queue.
+ *
+ * @param stats
+ * @param length the length of the list after the push.
+ * @param n number of pushed jobs.
+ * @param readyAt the times the jobs became ready in microseconds, or NULL for now.
+ */
+void Latency_Pushed(QueueStats *stats, long long length, long long n, const long long *readyAt);
+
+/**
+ * Record that jobs are popped from the head of the list of a queue.
+ *
+ * @param stats
+ * @param length the length of the list after the pop.
+ * @param n number of popped jobs.
+ */
+void Latency_Popped(QueueStats *stats, long long length, long long n);
+
+/**
+ * Record how long a worker was blocked.
+ *
+ * @param stats
+ * @param us
+ */
+void Latency_Blocked(QueueStats *stats, long long us);
+
+/**
+ * Record how late the timer migrated available jobs.
+ *
+ * @param stats
+ * @param us
+ */
+void Latency_Timer(QueueStats *stats, long long us);
+
+/**
+ * Free the latency histograms of a queue, with its ready times.
+ *
+ * @param latency
+ */
+void Latency_Free(QueueLatency *latency);
+
+/**
+ * Bytes taken by the tracked ready times of all queues.
+ */
+size_t Latency_ReadyTimesMemory(void);
+
+int Create_Laravel_Latency_Command(RedisModuleCtx *ctx);
+
+#endif //LARAVEL_QUEUE_LATENCY_H
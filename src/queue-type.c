@@ -0,0 +1,677 @@
+/*
+ * Copyright (c) 2018, Hamid Alaei Varnosfaderani
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "queue-type.h"
+
+#include <string.h>
+#include <strings.h>
+
+#include "compression.h"
+#include "config.h"
+#include "envelope.h"
+#include "job-attempts.h"
+
+#define LARAVEL_QUEUE_ENCODING_VERSION 0
+#define JOB_CONTAINER_INITIAL_CAPACITY 8
+
+RedisModuleType *LaravelQueueType;
+
+static size_t jobLength(RedisModuleString *job)
+{
+    size_t len;
+    RedisModule_StringPtrLen(job, &len);
+    return len;
+}
+
+/**
+ * Push a job to the back of the deque. The deque takes ownership of the job.
+ */
+void JobDeque_Push_Back(JobDeque *deque, RedisModuleString *job)
+{
+    if (deque->size == deque->capacity) {
+        size_t capacity = deque->capacity ? deque->capacity * 2 : JOB_CONTAINER_INITIAL_CAPACITY;
+        RedisModuleString **jobs = RedisModule_Alloc(sizeof(RedisModuleString *) * capacity);
+        for (size_t i = 0; i < deque->size; ++i) {
+            jobs[i] = deque->jobs[(deque->head + i) & (deque->capacity - 1)];
+        }
+        RedisModule_Free(deque->jobs);
+        deque->jobs = jobs;
+        deque->head = 0;
+        deque->capacity = capacity;
+    }
+    deque->jobs[(deque->head + deque->size) & (deque->capacity - 1)] = job;
+    deque->size++;
+    deque->bytes += jobLength(job);
+}
+
+/**
+ * Pop a job from the front of the deque. The caller takes ownership of the job.
+ */
+RedisModuleString * JobDeque_Pop_Front(JobDeque *deque)
+{
+    if (! deque->size) {
+        return NULL;
+    }
+    RedisModuleString *job = deque->jobs[deque->head];
+    deque->head = (deque->head + 1) & (deque->capacity - 1);
+    deque->size--;
+    deque->bytes -= jobLength(job);
+    return job;
+}
+
+static int jobHeapLess(JobHeapEntry *a, JobHeapEntry *b)
+{
+    if (a->score != b->score) {
+        return a->score < b->score;
+    }
+    return RedisModule_StringCompare(a->job, b->job) < 0;
+}
+
+static void jobHeapPlace(JobHeap *heap, JobHeapEntry *entry, size_t index)
+{
+    heap->entries[index] = entry;
+    entry->index = index;
+}
+
+static void jobHeapSiftUp(JobHeap *heap, size_t index)
+{
+    JobHeapEntry *entry = heap->entries[index];
+    while (index) {
+        size_t parent = (index - 1) / 2;
+        if (! jobHeapLess(entry, heap->entries[parent])) {
+            break;
+        }
+        jobHeapPlace(heap, heap->entries[parent], index);
+        index = parent;
+    }
+    jobHeapPlace(heap, entry, index);
+}
+
+static void jobHeapSiftDown(JobHeap *heap, size_t index)
+{
+    JobHeapEntry *entry = heap->entries[index];
+    for (;;) {
+        size_t child = 2 * index + 1;
+        if (child >= heap->size) {
+            break;
+        }
+        if (child + 1 < heap->size && jobHeapLess(heap->entries[child + 1], heap->entries[child])) {
+            child++;
+        }
+        if (! jobHeapLess(heap->entries[child], entry)) {
+            break;
+        }
+        jobHeapPlace(heap, heap->entries[child], index);
+        index = child;
+    }
+    jobHeapPlace(heap, entry, index);
+}
+
+/**
+ * Find the key of a job in the dictionary of a heap: its id if the heap is indexed by id and the job has one,
+ * otherwise the whole job.
+ *
+ * @return 1 if the key is the id of the job.
+ */
+static int jobHeapKey(JobHeap *heap, RedisModuleString *job, size_t *start, size_t *keyLen)
+{
+    size_t len;
+    const char *str = RedisModule_StringPtrLen(job, &len);
+    if (heap->byId) {
+        size_t offset = isJobEnvelope(str, len) ? JOB_ENVELOPE_HEADER_SIZE : 0;
+        size_t idStart, idEnd;
+        if (findJobId(str + offset, len - offset, &idStart, &idEnd)) {
+            *start = offset + idStart;
+            *keyLen = idEnd - idStart;
+            return 1;
+        }
+    }
+    *start = 0;
+    *keyLen = len;
+    return 0;
+}
+
+static char * jobHeapEntryKey(JobHeapEntry *entry)
+{
+    return (char *) RedisModule_StringPtrLen(entry->job, NULL) + entry->keyStart;
+}
+
+/**
+ * Find the entry of a job among the entries with the same key.
+ */
+static JobHeapEntry * jobHeapSameKeyFind(JobHeapEntry *entry, RedisModuleString *job)
+{
+    for (; entry; entry = entry->sameKey) {
+        if (entry->job == job || RedisModule_StringCompare(entry->job, job) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Remove an entry from the dictionary, putting the next entry with the same key in its place.
+ */
+static void jobHeapUnindex(JobHeap *heap, JobHeapEntry *entry)
+{
+    char *key = jobHeapEntryKey(entry);
+    JobHeapEntry *head = RedisModule_DictGetC(heap->jobs, key, entry->keyLen, NULL);
+    if (head != entry) {
+        while (head->sameKey != entry) {
+            head = head->sameKey;
+        }
+        head->sameKey = entry->sameKey;
+        return;
+    }
+    RedisModule_DictDelC(heap->jobs, key, entry->keyLen, NULL);
+    if (entry->sameKey) {
+        RedisModule_DictSetC(heap->jobs, key, entry->keyLen, entry->sameKey);
+    } else {
+        heap->keyBytes -= entry->keyLen;
+    }
+}
+
+/**
+ * Remove an entry from the heap and free it. The caller takes ownership of the job.
+ */
+static RedisModuleString * jobHeapRemove(JobHeap *heap, JobHeapEntry *entry)
+{
+    size_t index = entry->index;
+    RedisModuleString *job = entry->job;
+    jobHeapUnindex(heap, entry);
+    heap->size--;
+    heap->bytes -= jobLength(job);
+    if (index != heap->size) {
+        JobHeapEntry *last = heap->entries[heap->size];
+        jobHeapPlace(heap, last, index);
+        jobHeapSiftUp(heap, index);
+        jobHeapSiftDown(heap, last->index);
+    }
+    RedisModule_Free(entry);
+    return job;
+}
+
+/**
+ * Add a job or update its score. The heap takes ownership of the job.
+ */
+int JobHeap_Add(JobHeap *heap, double score, RedisModuleString *job)
+{
+    if (! heap->jobs) {
+        heap->jobs = RedisModule_CreateDict(NULL);
+    }
+    size_t keyStart, keyLen;
+    int isId = jobHeapKey(heap, job, &keyStart, &keyLen);
+    char *key = (char *) RedisModule_StringPtrLen(job, NULL) + keyStart;
+    JobHeapEntry *head = RedisModule_DictGetC(heap->jobs, key, keyLen, NULL);
+    // A job without an id is its own key, and only the same job can have the same key.
+    JobHeapEntry *entry = isId ? jobHeapSameKeyFind(head, job) : head;
+    if (entry) {
+        if (entry->job != job) {
+            RedisModule_FreeString(NULL, job);
+        }
+        JobHeap_Update(heap, entry, score);
+        return 0;
+    }
+    if (heap->size == heap->capacity) {
+        heap->capacity = heap->capacity ? heap->capacity * 2 : JOB_CONTAINER_INITIAL_CAPACITY;
+        heap->entries = RedisModule_Realloc(heap->entries, sizeof(JobHeapEntry *) * heap->capacity);
+    }
+    entry = RedisModule_Alloc(sizeof(JobHeapEntry));
+    entry->score = score;
+    entry->job = job;
+    entry->keyStart = keyStart;
+    entry->keyLen = keyLen;
+    entry->sameKey = head;
+    if (head) {
+        // Another job with the same id: both are kept, and the id refers to the last one.
+        RedisModule_DictDelC(heap->jobs, key, keyLen, NULL);
+    } else {
+        heap->keyBytes += keyLen;
+    }
+    RedisModule_DictSetC(heap->jobs, key, keyLen, entry);
+    heap->bytes += jobLength(job);
+    jobHeapPlace(heap, entry, heap->size++);
+    jobHeapSiftUp(heap, entry->index);
+    return 1;
+}
+
+/**
+ * Delete a job from the heap.
+ */
+int JobHeap_Delete(JobHeap *heap, RedisModuleString *job)
+{
+    RedisModuleString *removed = JobHeap_Take(heap, job);
+    if (! removed) {
+        return 0;
+    }
+    RedisModule_FreeString(NULL, removed);
+    return 1;
+}
+
+/**
+ * Remove a job from the heap, or the job of an id if the heap is indexed by id. The caller takes ownership of the job.
+ */
+RedisModuleString * JobHeap_Take(JobHeap *heap, RedisModuleString *job)
+{
+    JobHeapEntry *entry = JobHeap_Find(heap, job);
+    return entry ? jobHeapRemove(heap, entry) : NULL;
+}
+
+/**
+ * Find the entry of a job, or of a job id if the heap is indexed by id.
+ */
+JobHeapEntry * JobHeap_Find(JobHeap *heap, RedisModuleString *job)
+{
+    if (! heap->jobs) {
+        return NULL;
+    }
+    size_t keyStart, keyLen;
+    int isId = jobHeapKey(heap, job, &keyStart, &keyLen);
+    char *key = (char *) RedisModule_StringPtrLen(job, NULL) + keyStart;
+    JobHeapEntry *entry = RedisModule_DictGetC(heap->jobs, key, keyLen, NULL);
+    return isId ? jobHeapSameKeyFind(entry, job) : entry;
+}
+
+/**
+ * Change the score of an entry.
+ */
+void JobHeap_Update(JobHeap *heap, JobHeapEntry *entry, double score)
+{
+    entry->score = score;
+    jobHeapSiftUp(heap, entry->index);
+    jobHeapSiftDown(heap, entry->index);
+}
+
+/**
+ * Whether a job is given by its id, i.e. the heap is indexed by id and the job is neither json, an envelope,
+ * nor compressed.
+ */
+int JobHeap_IsId(JobHeap *heap, RedisModuleString *job)
+{
+    size_t len;
+    const char *str = RedisModule_StringPtrLen(job, &len);
+    return heap->byId && (! len || (str[0] != '{' && ! isJobEnvelope(str, len) && ! isCompressedJob(str, len)));
+}
+
+/**
+ * Get the entry with the minimum score.
+ */
+JobHeapEntry * JobHeap_Min(JobHeap *heap)
+{
+    return heap->size ? heap->entries[0] : NULL;
+}
+
+/**
+ * Pop the job with the minimum score. The caller takes ownership of the job.
+ */
+RedisModuleString * JobHeap_Pop_Min(JobHeap *heap)
+{
+    return heap->size ? jobHeapRemove(heap, heap->entries[0]) : NULL;
+}
+
+/**
+ * Get the delayed or reserved heap of a queue by the suffix of its sorted set.
+ */
+JobHeap * LaravelQueue_Heap(LaravelQueue *queue, const char *suffix)
+{
+    return strcmp(suffix, ":delayed") ? &queue->reserved : &queue->delayed;
+}
+
+static LaravelQueue * createLaravelQueue()
+{
+    LaravelQueue *queue = RedisModule_Alloc(sizeof(LaravelQueue));
+    memset(queue, 0, sizeof(LaravelQueue));
+    queue->reserved.byId = laravelQueueConfig.reserveById;
+    return queue;
+}
+
+static void freeJobHeap(JobHeap *heap)
+{
+    for (size_t i = 0; i < heap->size; ++i) {
+        RedisModule_FreeString(NULL, heap->entries[i]->job);
+        RedisModule_Free(heap->entries[i]);
+    }
+    RedisModule_Free(heap->entries);
+    if (heap->jobs) {
+        RedisModule_FreeDict(NULL, heap->jobs);
+    }
+}
+
+static void freeLaravelQueue(void *value)
+{
+    LaravelQueue *queue = value;
+    RedisModuleString *job;
+    while ((job = JobDeque_Pop_Front(&queue->ready))) {
+        RedisModule_FreeString(NULL, job);
+    }
+    RedisModule_Free(queue->ready.jobs);
+    freeJobHeap(&queue->delayed);
+    freeJobHeap(&queue->reserved);
+    RedisModule_Free(queue);
+}
+
+static void saveJobHeap(RedisModuleIO *rdb, JobHeap *heap)
+{
+    RedisModule_SaveUnsigned(rdb, heap->size);
+    for (size_t i = 0; i < heap->size; ++i) {
+        RedisModule_SaveDouble(rdb, heap->entries[i]->score);
+        RedisModule_SaveString(rdb, heap->entries[i]->job);
+    }
+}
+
+static void saveLaravelQueue(RedisModuleIO *rdb, void *value)
+{
+    LaravelQueue *queue = value;
+    RedisModule_SaveUnsigned(rdb, queue->ready.size);
+    for (size_t i = 0; i < queue->ready.size; ++i) {
+        RedisModule_SaveString(rdb, queue->ready.jobs[(queue->ready.head + i) & (queue->ready.capacity - 1)]);
+    }
+    saveJobHeap(rdb, &queue->delayed);
+    saveJobHeap(rdb, &queue->reserved);
+}
+
+static void loadJobHeap(RedisModuleIO *rdb, JobHeap *heap)
+{
+    uint64_t size = RedisModule_LoadUnsigned(rdb);
+    for (uint64_t i = 0; i < size; ++i) {
+        double score = RedisModule_LoadDouble(rdb);
+        RedisModuleString *job = RedisModule_LoadString(rdb);
+        noteStoredJob(job);
+        JobHeap_Add(heap, score, job);
+    }
+}
+
+static void * loadLaravelQueue(RedisModuleIO *rdb, int encver)
+{
+    if (encver != LARAVEL_QUEUE_ENCODING_VERSION) {
+        return NULL;
+    }
+    LaravelQueue *queue = createLaravelQueue();
+    uint64_t size = RedisModule_LoadUnsigned(rdb);
+    for (uint64_t i = 0; i < size; ++i) {
+        JobDeque_Push_Back(&queue->ready, RedisModule_LoadString(rdb));
+    }
+    loadJobHeap(rdb, &queue->delayed);
+    loadJobHeap(rdb, &queue->reserved);
+    return queue;
+}
+
+static void rewriteJobHeap(RedisModuleIO *aof, RedisModuleString *key, JobHeap *heap, const char *name)
+{
+    for (size_t i = 0; i < heap->size; ++i) {
+        RedisModuleString *score = RedisModule_CreateStringPrintf(NULL, "%.17g", heap->entries[i]->score);
+        RedisModule_EmitAOF(aof, "laravel.native", "sccss", key, "ZADD", name, score, heap->entries[i]->job);
+        RedisModule_FreeString(NULL, score);
+    }
+}
+
+static void rewriteLaravelQueue(RedisModuleIO *aof, RedisModuleString *key, void *value)
+{
+    LaravelQueue *queue = value;
+    for (size_t i = 0; i < queue->ready.size; ++i) {
+        RedisModule_EmitAOF(aof, "laravel.native", "scs", key, "RPUSH",
+                            queue->ready.jobs[(queue->ready.head + i) & (queue->ready.capacity - 1)]);
+    }
+    rewriteJobHeap(aof, key, &queue->delayed, "DELAYED");
+    rewriteJobHeap(aof, key, &queue->reserved, "RESERVED");
+}
+
+static size_t memUsageLaravelQueue(const void *value)
+{
+    const LaravelQueue *queue = value;
+    // The delayed and reserved jobs are held by the heap entries, and their keys by the dictionaries of jobs.
+    return sizeof(LaravelQueue) + queue->ready.capacity * sizeof(RedisModuleString *) + queue->ready.bytes +
+           (queue->delayed.capacity + queue->reserved.capacity) * sizeof(JobHeapEntry *) +
+           (queue->delayed.size + queue->reserved.size) * sizeof(JobHeapEntry) +
+           queue->delayed.bytes + queue->reserved.bytes + queue->delayed.keyBytes + queue->reserved.keyBytes;
+}
+
+/**
+ * Whether the keys of a queue and of its sorted sets are in the same slot, so the commands given one of them can open
+ * the others. Outside cluster mode they always are, and in cluster mode the queue name must have a hash tag.
+ */
+static int sameSlotAsZsets(RedisModuleCtx *ctx, RedisModuleString *strQueue)
+{
+    if (! (RedisModule_GetContextFlags(ctx) & REDISMODULE_CTX_FLAGS_CLUSTER)) {
+        return 1;
+    }
+    size_t len;
+    const char *str = RedisModule_StringPtrLen(strQueue, &len);
+    const char *open = memchr(str, '{', len);
+    if (! open) {
+        return 0;
+    }
+    const char *close = memchr(open + 1, '}', len - (size_t) (open + 1 - str));
+    return close && close > open + 1;
+}
+
+static int legacyZsetExists(RedisModuleCtx *ctx, RedisModuleString *strQueue, const char *suffix)
+{
+    size_t len;
+    const char *str = RedisModule_StringPtrLen(strQueue, &len);
+    RedisModuleString *strZset = RedisModule_CreateString(ctx, str, len);
+    RedisModule_StringAppendBuffer(ctx, strZset, suffix, strlen(suffix));
+    RedisModuleKey *zset = RedisModule_OpenKey(ctx, strZset, REDISMODULE_READ);
+    int exists = RedisModule_KeyType(zset) != REDISMODULE_KEYTYPE_EMPTY;
+    RedisModule_CloseKey(zset);
+    RedisModule_FreeString(ctx, strZset);
+    return exists;
+}
+
+/**
+ * Get the native queue of a key.
+ */
+LaravelQueue * getNativeQueue(RedisModuleCtx *ctx, RedisModuleKey *key, RedisModuleString *strQueue, int create)
+{
+    if (! laravelQueueConfig.nativeType) {
+        return NULL;
+    }
+    int type = RedisModule_KeyType(key);
+    if (type == REDISMODULE_KEYTYPE_MODULE) {
+        return RedisModule_ModuleTypeGetType(key) == LaravelQueueType ? RedisModule_ModuleTypeGetValue(key) : NULL;
+    }
+    if (type != REDISMODULE_KEYTYPE_EMPTY || ! create || ! sameSlotAsZsets(ctx, strQueue)) {
+        return NULL;
+    }
+    // Keep using the legacy keys until they are drained.
+    if (legacyZsetExists(ctx, strQueue, ":delayed") || legacyZsetExists(ctx, strQueue, ":reserved")) {
+        return NULL;
+    }
+    LaravelQueue *queue = createLaravelQueue();
+    RedisModule_ModuleTypeSetValue(key, LaravelQueueType, queue);
+    return queue;
+}
+
+/**
+ * Get the name of the queue of a delayed or reserved sorted set.
+ */
+RedisModuleString * queueNameOf(RedisModuleCtx *ctx, RedisModuleString *strZset, const char *suffix)
+{
+    size_t slen = strlen(suffix);
+    size_t len;
+    const char *zset = RedisModule_StringPtrLen(strZset, &len);
+    if (len < slen || memcmp(suffix, zset + len - slen, slen)) {
+        return NULL;
+    }
+    return RedisModule_CreateString(ctx, zset, len - slen);
+}
+
+/**
+ * Open the native queue of a delayed or reserved sorted set, when native queues are enabled.
+ */
+LaravelQueue * openNativeQueueOf(RedisModuleCtx *ctx, RedisModuleString *strZset, const char *suffix, int create,
+                                 RedisModuleKey **key, RedisModuleString **strQueue)
+{
+    if (! laravelQueueConfig.nativeType) {
+        return NULL;
+    }
+    RedisModuleString *name = queueNameOf(ctx, strZset, suffix);
+    if (! name) {
+        return NULL;
+    }
+    if (! sameSlotAsZsets(ctx, name)) {
+        RedisModule_FreeString(ctx, name);
+        return NULL;
+    }
+    RedisModuleKey *queueKey = RedisModule_OpenKey(ctx, name, REDISMODULE_WRITE);
+    LaravelQueue *queue = getNativeQueue(ctx, queueKey, name, create);
+    if (! queue) {
+        RedisModule_CloseKey(queueKey);
+        RedisModule_FreeString(ctx, name);
+        return NULL;
+    }
+    *key = queueKey;
+    *strQueue = name;
+    return queue;
+}
+
+/**
+ * Delete the key of a native queue if it has no jobs.
+ */
+void deleteNativeQueueIfEmpty(RedisModuleKey *key, LaravelQueue *queue)
+{
+    if (! queue->ready.size && ! queue->delayed.size && ! queue->reserved.size) {
+        RedisModule_DeleteKey(key);
+    }
+}
+
+static JobHeap * heapByName(LaravelQueue *queue, RedisModuleString *name)
+{
+    const char *str = RedisModule_StringPtrLen(name, NULL);
+    if (! strcasecmp(str, "DELAYED")) {
+        return &queue->delayed;
+    }
+    if (! strcasecmp(str, "RESERVED")) {
+        return &queue->reserved;
+    }
+    return NULL;
+}
+
+/**
+ * laravel.native <queue> RPUSH <job> [job ...]
+ * laravel.native <queue> LPOP <count>
+ * laravel.native <queue> ZADD DELAYED|RESERVED <score> <job> [score job ...]
+ * laravel.native <queue> ZREM DELAYED|RESERVED <job> [job ...]
+ * laravel.native <queue> MIGRATE DELAYED|RESERVED <count>
+ *
+ * Apply the effects of the laravel.* commands on a native queue. It is used for replication and AOF.
+ */
+int Laravel_Native_Command(RedisModuleCtx *ctx, RedisModuleString **argv, int argc)
+{
+    if (argc < 4) {
+        return RedisModule_WrongArity(ctx);
+    }
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_WRITE);
+    int type = RedisModule_KeyType(key);
+    if (type != REDISMODULE_KEYTYPE_EMPTY &&
+        (type != REDISMODULE_KEYTYPE_MODULE || RedisModule_ModuleTypeGetType(key) != LaravelQueueType)) {
+        RedisModule_CloseKey(key);
+        return RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+    }
+    LaravelQueue *queue;
+    if (type == REDISMODULE_KEYTYPE_EMPTY) {
+        queue = createLaravelQueue();
+        RedisModule_ModuleTypeSetValue(key, LaravelQueueType, queue);
+    } else {
+        queue = RedisModule_ModuleTypeGetValue(key);
+    }
+
+    const char *op = RedisModule_StringPtrLen(argv[2], NULL);
+    JobHeap *heap = argc > 4 ? heapByName(queue, argv[3]) : NULL;
+    long long count;
+    const char *error = NULL;
+    if (! strcasecmp(op, "RPUSH")) {
+        for (int i = 3; i < argc; ++i) {
+            RedisModule_RetainString(NULL, argv[i]);
+            JobDeque_Push_Back(&queue->ready, argv[i]);
+        }
+    } else if (! strcasecmp(op, "LPOP") && argc == 4 && RedisModule_StringToLongLong(argv[3], &count) == REDISMODULE_OK) {
+        RedisModuleString *job;
+        for (; count > 0 && (job = JobDeque_Pop_Front(&queue->ready)); --count) {
+            RedisModule_FreeString(NULL, job);
+        }
+    } else if (! strcasecmp(op, "ZADD") && heap && argc % 2 == 0) {
+        double score;
+        for (int i = 4; i < argc && ! error; i += 2) {
+            if (RedisModule_StringToDouble(argv[i], &score) != REDISMODULE_OK) {
+                error = "ERR score is not a valid float";
+            }
+        }
+        for (int i = 4; i < argc && ! error; i += 2) {
+            RedisModule_StringToDouble(argv[i], &score);
+            RedisModule_RetainString(NULL, argv[i + 1]);
+            noteStoredJob(argv[i + 1]);
+            JobHeap_Add(heap, score, argv[i + 1]);
+        }
+    } else if (! strcasecmp(op, "ZREM") && heap) {
+        for (int i = 4; i < argc; ++i) {
+            JobHeap_Delete(heap, argv[i]);
+        }
+    } else if (! strcasecmp(op, "MIGRATE") && heap && argc == 5 &&
+               RedisModule_StringToLongLong(argv[4], &count) == REDISMODULE_OK) {
+        RedisModuleString *job;
+        for (; count > 0 && (job = JobHeap_Pop_Min(heap)); --count) {
+            JobDeque_Push_Back(&queue->ready, job);
+        }
+    } else {
+        error = "ERR syntax error";
+    }
+
+    deleteNativeQueueIfEmpty(key, queue);
+    RedisModule_CloseKey(key);
+    if (error) {
+        return RedisModule_ReplyWithError(ctx, error);
+    }
+    RedisModule_ReplicateVerbatim(ctx);
+    return RedisModule_ReplyWithSimpleString(ctx, "OK");
+}
+
+int Create_Laravel_Queue_Type(RedisModuleCtx *ctx)
+{
+    RedisModuleTypeMethods methods = {
+            .version = 1,
+            .rdb_load = loadLaravelQueue,
+            .rdb_save = saveLaravelQueue,
+            .aof_rewrite = rewriteLaravelQueue,
+            .mem_usage = memUsageLaravelQueue,
+            .free = freeLaravelQueue,
+    };
+    LaravelQueueType = RedisModule_CreateDataType(ctx, "laravel-q", LARAVEL_QUEUE_ENCODING_VERSION, &methods);
+    if (LaravelQueueType == NULL) {
+        return REDISMODULE_ERR;
+    }
+    if (RedisModule_CreateCommand(ctx, "laravel.native", Laravel_Native_Command, "write deny-oom", 1, 1, 1)
+        == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
+
+    return REDISMODULE_OK;
+}
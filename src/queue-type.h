@@ -0,0 +1,252 @@
+/*
+ * Copyright (c) 2018, Hamid Alaei Varnosfaderani
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef LARAVEL_QUEUE_QUEUE_TYPE_H
+#define LARAVEL_QUEUE_QUEUE_TYPE_H
+
+#include "redismodule.h"
+#include "stats.h"
+
+/**
+ * Ready jobs, in a ring buffer.
+ */
+typedef struct JobDeque
+{
+    RedisModuleString **jobs;
+    size_t head;
+    size_t size;
+    size_t capacity;
+    size_t bytes;
+} JobDeque;
+
+/**
+ * A delayed or reserved job.
+ */
+typedef struct JobHeapEntry
+{
+    double score;
+    size_t index;
+    RedisModuleString *job;
+
+    /**
+     * Location of the key of the job in the dictionary of the heap, inside the job.
+     */
+    size_t keyStart;
+    size_t keyLen;
+
+    /**
+     * The next entry with the same key, when several jobs have the same id.
+     */
+    struct JobHeapEntry *sameKey;
+} JobHeapEntry;
+
+/**
+ * Delayed or reserved jobs, in a min-heap ordered by score and then by job, the same order as a sorted set.
+ */
+typedef struct JobHeap
+{
+    JobHeapEntry **entries;
+    size_t size;
+    size_t capacity;
+    size_t bytes;
+    size_t keyBytes;
+
+    /**
+     * Dictionary [job => JobHeapEntry], or [job id => JobHeapEntry] for the jobs that have an id if byId is set.
+     * The entries of the jobs with the same id are chained by sameKey, the last added first.
+     */
+    RedisModuleDict *jobs;
+    int byId;
+} JobHeap;
+
+/**
+ * Native laravel queue: the main list, the delayed and the reserved sorted sets in a single key.
+ */
+typedef struct LaravelQueue
+{
+    JobDeque ready;
+    JobHeap delayed;
+    JobHeap reserved;
+
+    /**
+     * The counters of the queue, looked up on first use. A renamed queue keeps counting under its old name.
+     */
+    QueueStatsCache stats;
+} LaravelQueue;
+
+extern RedisModuleType *LaravelQueueType;
+
+/**
+ * Push a job to the back of the deque. The deque takes ownership of the job.
+ *
+ * @param deque
+ * @param job
+ */
+void JobDeque_Push_Back(JobDeque *deque, RedisModuleString *job);
+
+/**
+ * Pop a job from the front of the deque. The caller takes ownership of the job.
+ *
+ * @param deque
+ * @return the job or NULL if the deque is empty.
+ */
+RedisModuleString * JobDeque_Pop_Front(JobDeque *deque);
+
+/**
+ * Add a job or update its score. The heap takes ownership of the job.
+ * A job with the same id as another one is added next to it, so no job is lost.
+ *
+ * @param heap
+ * @param score
+ * @param job
+ * @return 1 if added, 0 if updated.
+ */
+int JobHeap_Add(JobHeap *heap, double score, RedisModuleString *job);
+
+/**
+ * Delete a job from the heap.
+ *
+ * @param heap
+ * @param job
+ * @return 1 if deleted, 0 if not found.
+ */
+int JobHeap_Delete(JobHeap *heap, RedisModuleString *job);
+
+/**
+ * Remove a job from the heap. If the heap is indexed by id, the job can also be given by its id, which refers to the
+ * last added job with that id, and a job with the same id but a different payload is not removed.
+ * The caller takes ownership of the job.
+ *
+ * @param heap
+ * @param job a job or a job id.
+ * @return the removed job or NULL if not found.
+ */
+RedisModuleString * JobHeap_Take(JobHeap *heap, RedisModuleString *job);
+
+/**
+ * Find the entry of a job. If the heap is indexed by id, the job can also be given by its id, which refers to the
+ * last added job with that id, and a job with the same id but a different payload is not found.
+ *
+ * @param heap
+ * @param job a job or a job id.
+ * @return the entry or NULL if not found.
+ */
+JobHeapEntry * JobHeap_Find(JobHeap *heap, RedisModuleString *job);
+
+/**
+ * Change the score of an entry.
+ *
+ * @param heap
+ * @param entry
+ * @param score
+ */
+void JobHeap_Update(JobHeap *heap, JobHeapEntry *entry, double score);
+
+/**
+ * Whether a job is given by its id, i.e. the heap is indexed by id and the job is neither json, an envelope,
+ * nor compressed.
+ *
+ * @param heap
+ * @param job
+ */
+int JobHeap_IsId(JobHeap *heap, RedisModuleString *job);
+
+/**
+ * Get the entry with the minimum score.
+ *
+ * @param heap
+ * @return the entry or NULL if the heap is empty.
+ */
+JobHeapEntry * JobHeap_Min(JobHeap *heap);
+
+/**
+ * Pop the job with the minimum score. The caller takes ownership of the job.
+ *
+ * @param heap
+ * @return the job or NULL if the heap is empty.
+ */
+RedisModuleString * JobHeap_Pop_Min(JobHeap *heap);
+
+/**
+ * Get the delayed or reserved heap of a queue by the suffix of its sorted set.
+ *
+ * @param queue
+ * @param suffix ":delayed" or ":reserved"
+ * @return
+ */
+JobHeap * LaravelQueue_Heap(LaravelQueue *queue, const char *suffix);
+
+/**
+ * Get the native queue of a key.
+ *
+ * @param ctx
+ * @param key an open key.
+ * @param strQueue name of the key.
+ * @param create create the queue if the key is empty and there are no legacy delayed and reserved sorted sets.
+ * @return the queue or NULL if the key doesn't hold a native queue.
+ */
+LaravelQueue * getNativeQueue(RedisModuleCtx *ctx, RedisModuleKey *key, RedisModuleString *strQueue, int create);
+
+/**
+ * Get the name of the queue of a delayed or reserved sorted set.
+ *
+ * @param ctx
+ * @param strZset
+ * @param suffix
+ * @return a new string, or NULL if the sorted set name does not end with the suffix.
+ */
+RedisModuleString * queueNameOf(RedisModuleCtx *ctx, RedisModuleString *strZset, const char *suffix);
+
+/**
+ * Open the native queue of a delayed or reserved sorted set, when native queues are enabled.
+ *
+ * @param ctx
+ * @param strZset
+ * @param suffix
+ * @param create see getNativeQueue().
+ * @param key the open queue key, to be closed by the caller.
+ * @param strQueue the queue name, to be freed by the caller.
+ * @return the queue or NULL. key and strQueue are only set if the queue is returned.
+ */
+LaravelQueue * openNativeQueueOf(RedisModuleCtx *ctx, RedisModuleString *strZset, const char *suffix, int create,
+                                 RedisModuleKey **key, RedisModuleString **strQueue);
+
+/**
+ * Delete the key of a native queue if it has no jobs.
+ *
+ * @param key
+ * @param queue
+ */
+void deleteNativeQueueIfEmpty(RedisModuleKey *key, LaravelQueue *queue);
+
+int Create_Laravel_Queue_Type(RedisModuleCtx *ctx);
+
+#endif //LARAVEL_QUEUE_QUEUE_TYPE_H
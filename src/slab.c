@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2018, Hamid Alaei Varnosfaderani
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+#include "redismodule.h"
+#include "slab.h"
+
+/**
+ * Header of a slab, followed by SLAB_OBJECTS objects of its size class.
+ */
+struct Slab
+{
+    Slab *next;
+    // Keep the objects aligned.
+    union {
+        void *ptr;
+        long long ll;
+        double d;
+    } align[];
+};
+
+static int slabClassOf(size_t size)
+{
+    int i = 0;
+    size_t classSize = SLAB_MIN_SIZE;
+    while (classSize < size) {
+        classSize <<= 1;
+        i++;
+    }
+    return i;
+}
+
+#define slabClassSize(i) ((size_t) SLAB_MIN_SIZE << (i))
+
+void SlabArena_Init(SlabArena *arena)
+{
+    memset(arena, 0, sizeof(SlabArena));
+}
+
+void SlabArena_Drop(SlabArena *arena)
+{
+    for (int i = 0; i < SLAB_CLASSES; ++i) {
+        Slab *slab = arena->classes[i].slabs;
+        while (slab) {
+            Slab *next = slab->next;
+            RedisModule_Free(slab);
+            slab = next;
+        }
+    }
+    SlabArena_Init(arena);
+}
+
+/**
+ * Add a new slab to a size class and put its objects in the free list, in address order.
+ */
+static void slabClassGrow(SlabClass *class, size_t size)
+{
+    Slab *slab = RedisModule_Alloc(sizeof(Slab) + SLAB_OBJECTS * size);
+    slab->next = class->slabs;
+    class->slabs = slab;
+    char *objects = (char *) slab->align;
+    for (int i = SLAB_OBJECTS - 1; i >= 0; --i) {
+        void **object = (void **) (objects + i * size);
+        *object = class->freeList;
+        class->freeList = object;
+    }
+    class->objects += SLAB_OBJECTS;
+}
+
+void * Slab_Alloc(SlabArena *arena, size_t size)
+{
+    int i = slabClassOf(size);
+    if (i >= SLAB_CLASSES) {
+        return RedisModule_Alloc(size);
+    }
+    SlabClass *class = &arena->classes[i];
+    if (! class->freeList) {
+        slabClassGrow(class, slabClassSize(i));
+    }
+    void **object = class->freeList;
+    class->freeList = *object;
+    class->used++;
+    return object;
+}
+
+void Slab_Free(SlabArena *arena, void *ptr, size_t size)
+{
+    int i = slabClassOf(size);
+    if (i >= SLAB_CLASSES) {
+        RedisModule_Free(ptr);
+        return;
+    }
+    SlabClass *class = &arena->classes[i];
+    *(void **) ptr = class->freeList;
+    class->freeList = ptr;
+    class->used--;
+}
+
+void SlabArena_Stats(SlabArena *arena, SlabStats *stats)
+{
+    for (int i = 0; i < SLAB_CLASSES; ++i) {
+        SlabClass *class = &arena->classes[i];
+        stats->allocated += class->objects / SLAB_OBJECTS * sizeof(Slab) + class->objects * slabClassSize(i);
+        stats->used += class->used * slabClassSize(i);
+        stats->objects += class->used;
+    }
+}
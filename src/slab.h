@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2018, Hamid Alaei Varnosfaderani
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LARAVEL_QUEUE_SLAB_H
+#define LARAVEL_QUEUE_SLAB_H
+
+#include <stddef.h>
+
+/**
+ * Object sizes are rounded up to a power of two, from 16 to 512 bytes.
+ */
+#define SLAB_MIN_SIZE 16
+#define SLAB_CLASSES 6
+
+/**
+ * Number of objects in each slab.
+ */
+#define SLAB_OBJECTS 64
+
+typedef struct Slab Slab;
+
+/**
+ * Slabs and free list of a size class.
+ */
+typedef struct SlabClass
+{
+    Slab *slabs;
+    void *freeList;
+    size_t objects;
+    size_t used;
+} SlabClass;
+
+/**
+ * A set of size classes. Memory of the slabs is only given back when the arena is dropped.
+ */
+typedef struct SlabArena
+{
+    SlabClass classes[SLAB_CLASSES];
+} SlabArena;
+
+/**
+ * Occupancy of an arena.
+ */
+typedef struct SlabStats
+{
+    /**
+     * Bytes of the slabs, including their headers.
+     */
+    size_t allocated;
+
+    /**
+     * Bytes of the objects in use.
+     */
+    size_t used;
+
+    size_t objects;
+} SlabStats;
+
+/**
+ * Initialize an empty arena.
+ *
+ * @param arena
+ */
+void SlabArena_Init(SlabArena *arena);
+
+/**
+ * Free all the slabs of an arena. Objects allocated from it must not be used afterwards.
+ *
+ * @param arena
+ */
+void SlabArena_Drop(SlabArena *arena);
+
+/**
+ * Allocate an object.
+ *
+ * @param arena
+ * @param size at most 512 bytes.
+ * @return
+ */
+void * Slab_Alloc(SlabArena *arena, size_t size);
+
+/**
+ * Free an object.
+ *
+ * @param arena the arena it is allocated from.
+ * @param ptr
+ * @param size the size it is allocated with.
+ */
+void Slab_Free(SlabArena *arena, void *ptr, size_t size);
+
+/**
+ * Add the occupancy of an arena to the stats.
+ *
+ * @param arena
+ * @param stats
+ */
+void SlabArena_Stats(SlabArena *arena, SlabStats *stats);
+
+#endif //LARAVEL_QUEUE_SLAB_H
@@ -0,0 +1,322 @@
+/*
+ * Copyright (c) 2018, Hamid Alaei Varnosfaderani
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include "stats.h"
+#include "latency.h"
+
+/**
+ * Dictionary [database => Dictionary [queue name => QueueStats]]
+ */
+static RedisModuleDict *statsDbs = NULL;
+
+/**
+ * Incremented whenever counters are dropped, so cached counters are looked up again.
+ */
+static unsigned long long statsGeneration = 1;
+
+typedef struct QueueStatsField
+{
+    const char *name;
+    size_t offset;
+} QueueStatsField;
+
+static const QueueStatsField queueStatsFields[] = {
+    {"pushed", offsetof(QueueStats, pushed)},
+    {"later", offsetof(QueueStats, later)},
+    {"popped", offsetof(QueueStats, popped)},
+    {"empty_pops", offsetof(QueueStats, emptyPops)},
+    {"blocked_pops", offsetof(QueueStats, blockedPops)},
+    {"wake_ups", offsetof(QueueStats, wakeUps)},
+    {"timeouts", offsetof(QueueStats, timeouts)},
+    {"migrated_delayed", offsetof(QueueStats, migratedDelayed)},
+    {"migrated_reserved", offsetof(QueueStats, migratedReserved)},
+    {"invalid_jobs", offsetof(QueueStats, invalidJobs)},
+    {"released", offsetof(QueueStats, released)},
+    {"deleted", offsetof(QueueStats, deleted)},
+    {"extended", offsetof(QueueStats, extended)},
+    {"compressed_jobs", offsetof(QueueStats, compressedJobs)},
+    {"compression_input_bytes", offsetof(QueueStats, compressionInputBytes)},
+    {"compression_output_bytes", offsetof(QueueStats, compressionOutputBytes)},
+};
+
+#define QUEUE_STATS_FIELDS (sizeof(queueStatsFields) / sizeof(QueueStatsField))
+
+#define queueStatsField(stats, i) (*(long long *) ((char *) (stats) + queueStatsFields[i].offset))
+
+static RedisModuleDict * getStatsDb(int db, int create)
+{
+    if (! statsDbs) {
+        if (! create) {
+            return NULL;
+        }
+        statsDbs = RedisModule_CreateDict(NULL);
+    }
+    RedisModuleDict *queues = RedisModule_DictGetC(statsDbs, &db, sizeof(int), NULL);
+    if (! queues && create) {
+        queues = RedisModule_CreateDict(NULL);
+        RedisModule_DictSetC(statsDbs, &db, sizeof(int), queues);
+    }
+    return queues;
+}
+
+QueueStats * getQueueStats(RedisModuleCtx *ctx, RedisModuleString *strKey, const char *suffix)
+{
+    RedisModuleDict *queues = getStatsDb(RedisModule_GetSelectedDb(ctx), 1);
+    size_t len;
+    const char *key = RedisModule_StringPtrLen(strKey, &len);
+    size_t slen = strlen(suffix);
+    if (len >= slen && memcmp(key + len - slen, suffix, slen) == 0) {
+        len -= slen;
+    }
+    QueueStats *stats = RedisModule_DictGetC(queues, (void *) key, len, NULL);
+    if (! stats) {
+        stats = RedisModule_Calloc(1, sizeof(QueueStats));
+        RedisModule_DictSetC(queues, (void *) key, len, stats);
+    }
+    return stats;
+}
+
+QueueStats * getCachedQueueStats(RedisModuleCtx *ctx, QueueStatsCache *cache, RedisModuleString *strKey,
+                                 const char *suffix)
+{
+    if (! cache) {
+        return getQueueStats(ctx, strKey, suffix);
+    }
+    if (! cache->stats || cache->generation != statsGeneration) {
+        cache->stats = getQueueStats(ctx, strKey, suffix);
+        cache->generation = statsGeneration;
+    }
+    return cache->stats;
+}
+
+QueueStats * findQueueStats(RedisModuleCtx *ctx, RedisModuleString *strQueue)
+{
+    RedisModuleDict *queues = getStatsDb(RedisModule_GetSelectedDb(ctx), 0);
+    return queues ? RedisModule_DictGet(queues, strQueue, NULL) : NULL;
+}
+
+QueueStats * findCachedQueueStats(RedisModuleCtx *ctx, QueueStatsCache *cache, RedisModuleString *strQueue)
+{
+    if (! cache->stats || cache->generation != statsGeneration) {
+        cache->stats = findQueueStats(ctx, strQueue);
+        cache->generation = statsGeneration;
+    }
+    return cache->stats;
+}
+
+static void freeQueueStats(QueueStats *stats)
+{
+    if (stats->latency) {
+        Latency_Free(stats->latency);
+    }
+    RedisModule_Free(stats);
+}
+
+/**
+ * Drop the counters of a queue, or of all queues of the database.
+ */
+static void dropQueueStats(RedisModuleCtx *ctx, RedisModuleString *strQueue)
+{
+    int db = RedisModule_GetSelectedDb(ctx);
+    RedisModuleDict *queues = getStatsDb(db, 0);
+    if (! queues) {
+        return;
+    }
+    statsGeneration++;
+    if (strQueue) {
+        QueueStats *stats;
+        if (RedisModule_DictDel(queues, strQueue, &stats) == REDISMODULE_OK) {
+            freeQueueStats(stats);
+        }
+        return;
+    }
+    RedisModuleDictIter *iter = RedisModule_DictIteratorStartC(queues, "^", NULL, 0);
+    QueueStats *stats;
+    while (RedisModule_DictNextC(iter, NULL, (void **) &stats)) {
+        freeQueueStats(stats);
+    }
+    RedisModule_DictIteratorStop(iter);
+    RedisModule_FreeDict(NULL, queues);
+    RedisModule_DictDelC(statsDbs, &db, sizeof(int), NULL);
+}
+
+RedisModuleDict * getQueueStatsDict(RedisModuleCtx *ctx)
+{
+    return getStatsDb(RedisModule_GetSelectedDb(ctx), 0);
+}
+
+static void replyWithQueueStats(RedisModuleCtx *ctx, QueueStats *stats)
+{
+    RedisModule_ReplyWithArray(ctx, 2 * QUEUE_STATS_FIELDS);
+    for (size_t i = 0; i < QUEUE_STATS_FIELDS; ++i) {
+        RedisModule_ReplyWithSimpleString(ctx, queueStatsFields[i].name);
+        RedisModule_ReplyWithLongLong(ctx, queueStatsField(stats, i));
+    }
+}
+
+/**
+ * laravel.stats [queue]
+ * laravel.stats RESET [queue]
+ *
+ * Reply with [field, value, ...] of the queue, or with [queue, [field, value, ...], ...] of all queues of the database.
+ * RESET drops the counters and latency histograms of the queue, or of all queues of the database, freeing them.
+ */
+int Laravel_Stats_Command(RedisModuleCtx *ctx, RedisModuleString **argv, int argc)
+{
+    if (argc > 1 && ! strcasecmp(RedisModule_StringPtrLen(argv[1], NULL), "RESET")) {
+        if (argc > 3) {
+            return RedisModule_WrongArity(ctx);
+        }
+        dropQueueStats(ctx, argc == 3 ? argv[2] : NULL);
+        return RedisModule_ReplyWithSimpleString(ctx, "OK");
+    }
+    if (argc > 2) {
+        return RedisModule_WrongArity(ctx);
+    }
+    RedisModuleDict *queues = getStatsDb(RedisModule_GetSelectedDb(ctx), 0);
+    if (argc == 2) {
+        QueueStats empty;
+        memset(&empty, 0, sizeof(QueueStats));
+        QueueStats *stats = findQueueStats(ctx, argv[1]);
+        replyWithQueueStats(ctx, stats ? stats : &empty);
+        return REDISMODULE_OK;
+    }
+    if (! queues) {
+        return RedisModule_ReplyWithArray(ctx, 0);
+    }
+    RedisModule_ReplyWithArray(ctx, 2 * RedisModule_DictSize(queues));
+    RedisModuleDictIter *iter = RedisModule_DictIteratorStartC(queues, "^", NULL, 0);
+    size_t len;
+    char *queue;
+    QueueStats *stats;
+    while ((queue = RedisModule_DictNextC(iter, &len, (void **) &stats))) {
+        RedisModule_ReplyWithStringBuffer(ctx, queue, len);
+        replyWithQueueStats(ctx, stats);
+    }
+    RedisModule_DictIteratorStop(iter);
+    return REDISMODULE_OK;
+}
+
+#define INFO_FIELD_NAME_SIZE 128
+/**
+ * Room kept at the end of an altered field name for the suffix that tells it apart.
+ */
+#define INFO_FIELD_SUFFIX_SIZE 12
+
+/**
+ * Write the INFO field name of a queue: db<N>_<queue> with the characters INFO uses as separators replaced by '_'.
+ *
+ * @return 1 if the name is not the queue name as is, because a character was replaced or it was truncated.
+ */
+static int infoFieldName(char *name, int db, const char *queue, size_t len)
+{
+    int prefix = snprintf(name, INFO_FIELD_NAME_SIZE, "db%d_", db);
+    int altered = len > INFO_FIELD_NAME_SIZE - prefix - 1;
+    size_t n = altered ? INFO_FIELD_NAME_SIZE - prefix - 1 - INFO_FIELD_SUFFIX_SIZE : len;
+    for (size_t i = 0; i < n; ++i) {
+        char c = queue[i];
+        int separator = c == ':' || c == ',' || c == '=' || c <= ' ';
+        name[prefix + i] = separator ? '_' : c;
+        altered |= separator;
+    }
+    name[prefix + n] = 0;
+    return altered;
+}
+
+/**
+ * One dictionary field per queue. Altered names that collide with another field get a _<n> suffix, so parsers don't
+ * overwrite one queue with another.
+ */
+static void queueStatsInfo(RedisModuleInfoCtx *ctx, int for_crash_report)
+{
+    REDISMODULE_NOT_USED(for_crash_report);
+    RedisModule_InfoAddSection(ctx, "");
+    if (! statsDbs) {
+        return;
+    }
+    // The field names taken so far, starting with the queue names that are used as is.
+    RedisModuleDict *names = RedisModule_CreateDict(NULL);
+    char name[INFO_FIELD_NAME_SIZE];
+    RedisModuleDictIter *dbIter = RedisModule_DictIteratorStartC(statsDbs, "^", NULL, 0);
+    int *db;
+    RedisModuleDict *queues;
+    size_t len;
+    char *queue;
+    QueueStats *stats;
+    while ((db = RedisModule_DictNextC(dbIter, NULL, (void **) &queues))) {
+        RedisModuleDictIter *iter = RedisModule_DictIteratorStartC(queues, "^", NULL, 0);
+        while ((queue = RedisModule_DictNextC(iter, &len, NULL))) {
+            if (! infoFieldName(name, *db, queue, len)) {
+                RedisModule_DictSetC(names, name, strlen(name), NULL);
+            }
+        }
+        RedisModule_DictIteratorStop(iter);
+    }
+    RedisModule_DictIteratorStop(dbIter);
+
+    dbIter = RedisModule_DictIteratorStartC(statsDbs, "^", NULL, 0);
+    while ((db = RedisModule_DictNextC(dbIter, NULL, (void **) &queues))) {
+        RedisModuleDictIter *iter = RedisModule_DictIteratorStartC(queues, "^", NULL, 0);
+        while ((queue = RedisModule_DictNextC(iter, &len, (void **) &stats))) {
+            if (infoFieldName(name, *db, queue, len)) {
+                size_t base = strlen(name);
+                for (int i = 2; RedisModule_DictSetC(names, name, strlen(name), NULL) != REDISMODULE_OK; ++i) {
+                    snprintf(name + base, INFO_FIELD_NAME_SIZE - base, "_%d", i);
+                }
+            }
+            RedisModule_InfoBeginDictField(ctx, name);
+            for (size_t i = 0; i < QUEUE_STATS_FIELDS; ++i) {
+                RedisModule_InfoAddFieldLongLong(ctx, (char *) queueStatsFields[i].name, queueStatsField(stats, i));
+            }
+            RedisModule_InfoEndDictField(ctx);
+        }
+        RedisModule_DictIteratorStop(iter);
+    }
+    RedisModule_DictIteratorStop(dbIter);
+    RedisModule_FreeDict(NULL, names);
+}
+
+int Create_Laravel_Stats_Command(RedisModuleCtx *ctx)
+{
+    if (RedisModule_CreateCommand(ctx, "laravel.stats", Laravel_Stats_Command, "readonly fast", 0, 0, 0)
+        == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
+    // INFO sections of modules need Redis 6.0 or higher.
+    if (RedisModule_RegisterInfoFunc && RedisModule_RegisterInfoFunc(ctx, queueStatsInfo) == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
+
+    return REDISMODULE_OK;
+}
@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2018, Hamid Alaei Varnosfaderani
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LARAVEL_QUEUE_STATS_H
+#define LARAVEL_QUEUE_STATS_H
+
+#include "redismodule.h"
+
+/**
+ * Counters of a queue, since the module is loaded.
+ */
+typedef struct QueueStats
+{
+    long long pushed;
+    long long later;
+    long long popped;
+    long long emptyPops;
+    long long blockedPops;
+    long long wakeUps;
+    long long timeouts;
+    long long migratedDelayed;
+    long long migratedReserved;
+    long long invalidJobs;
+    long long released;
+    long long deleted;
+    long long extended;
+    long long compressedJobs;
+    long long compressionInputBytes;
+    long long compressionOutputBytes;
+
+    /**
+     * Latency histograms, allocated on first use.
+     */
+    struct QueueLatency *latency;
+} QueueStats;
+
+/**
+ * The counters of a queue held by an object of the queue, so they are only looked up once.
+ * The cache is looked up again once the counters of any queue were dropped. A zeroed cache is empty.
+ */
+typedef struct QueueStatsCache
+{
+    QueueStats *stats;
+    unsigned long long generation;
+} QueueStatsCache;
+
+/**
+ * Get the counters of a queue, creating them on first use.
+ *
+ * @param ctx
+ * @param strKey name of the queue, or of its delayed/reserved sorted set.
+ * @param suffix the suffix to strip from strKey: "", ":delayed" or ":reserved".
+ * @return
+ */
+QueueStats * getQueueStats(RedisModuleCtx *ctx, RedisModuleString *strKey, const char *suffix);
+
+/**
+ * Get the counters of a queue through a cache held by an object of the queue.
+ *
+ * @param ctx
+ * @param cache or NULL to look them up.
+ * @param strKey see getQueueStats().
+ * @param suffix
+ * @return
+ */
+QueueStats * getCachedQueueStats(RedisModuleCtx *ctx, QueueStatsCache *cache, RedisModuleString *strKey,
+                                 const char *suffix);
+
+/**
+ * Get the counters of a queue if it has any.
+ *
+ * @param ctx
+ * @param strQueue
+ * @return
+ */
+QueueStats * findQueueStats(RedisModuleCtx *ctx, RedisModuleString *strQueue);
+
+/**
+ * Get the counters of a queue if it has any, through a cache held by an object of the queue.
+ *
+ * @param ctx
+ * @param cache
+ * @param strQueue
+ * @return
+ */
+QueueStats * findCachedQueueStats(RedisModuleCtx *ctx, QueueStatsCache *cache, RedisModuleString *strQueue);
+
+/**
+ * Get the dictionary [queue name => QueueStats] of the selected database, or NULL if it has no queue.
+ *
+ * @param ctx
+ * @return
+ */
+RedisModuleDict * getQueueStatsDict(RedisModuleCtx *ctx);
+
+/**
+ * Create laravel.stats and register the INFO section, on servers that support it.
+ *
+ * @param ctx
+ * @return
+ */
+int Create_Laravel_Stats_Command(RedisModuleCtx *ctx);
+
+#endif //LARAVEL_QUEUE_STATS_H
@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2018, Hamid Alaei Varnosfaderani
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <pthread.h>
+#include "redismodule.h"
+#include "thread-pool.h"
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t available = PTHREAD_COND_INITIALIZER;
+static ThreadPoolTask *front;
+static ThreadPoolTask *back;
+static int started;
+
+static void * worker(void *arg)
+{
+    for (;;) {
+        pthread_mutex_lock(&mutex);
+        while (! front) {
+            pthread_cond_wait(&available, &mutex);
+        }
+        ThreadPoolTask *task = front;
+        front = task->next;
+        if (! front) {
+            back = NULL;
+        }
+        pthread_mutex_unlock(&mutex);
+        task->run(task);
+    }
+    return NULL;
+}
+
+int ThreadPool_Start(int threads)
+{
+    for (int i = 0; i < threads; ++i) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, worker, NULL)) {
+            return REDISMODULE_ERR;
+        }
+        pthread_detach(thread);
+        started++;
+    }
+    return REDISMODULE_OK;
+}
+
+int ThreadPool_Started()
+{
+    return started > 0;
+}
+
+void ThreadPool_Submit(ThreadPoolTask *task)
+{
+    task->next = NULL;
+    pthread_mutex_lock(&mutex);
+    if (back) {
+        back->next = task;
+    } else {
+        front = task;
+    }
+    back = task;
+    pthread_cond_signal(&available);
+    pthread_mutex_unlock(&mutex);
+}
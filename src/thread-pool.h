@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2018, Hamid Alaei Varnosfaderani
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LARAVEL_QUEUE_THREAD_POOL_H
+#define LARAVEL_QUEUE_THREAD_POOL_H
+
+/**
+ * A unit of work, embedded in the struct that holds its data.
+ */
+typedef struct ThreadPoolTask
+{
+    struct ThreadPoolTask *next;
+    void (*run)(struct ThreadPoolTask *task);
+} ThreadPoolTask;
+
+/**
+ * Start the worker threads.
+ *
+ * @param threads
+ * @return REDISMODULE_OK, or REDISMODULE_ERR if a thread could not be created.
+ */
+int ThreadPool_Start(int threads);
+
+/**
+ * Whether the pool has any thread to run tasks.
+ */
+int ThreadPool_Started();
+
+/**
+ * Run a task on one of the worker threads, in the order they are submitted.
+ *
+ * @param task
+ */
+void ThreadPool_Submit(ThreadPoolTask *task);
+
+#endif //LARAVEL_QUEUE_THREAD_POOL_H